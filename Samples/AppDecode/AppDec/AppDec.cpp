@@ -15,7 +15,9 @@
 #include <cuda.h>
 #include "NvDecoder/NvDecoder.h"
 #include "../Utils/NvCodecUtils.h"
+#include "../Utils/RawFrameIO.h"
 #include "../Utils/FFmpegDemuxer.h"
+#include "../Utils/ElementaryStreamDemuxer.h"
 
 simplelogger::Logger *logger = simplelogger::LoggerFactory::CreateConsoleLogger();
 
@@ -32,42 +34,64 @@ void ConvertToPlanar(uint8_t *pHostFrame, int nWidth, int nHeight, int nBitDepth
     }
 }
 
+/**
+*   @brief  Demuxer is FFmpegDemuxer, or ElementaryStreamDemuxer for raw H.264/HEVC files
+*/
+template <typename Demuxer>
 void DecodeMediaFile(CUcontext cuContext, const char *szInFilePath, const char *szOutFilePath, bool bOutPlanar,
-    const Rect &cropRect, const Dim &resizeDim)
+    bool bDirectIo, const Rect &cropRect, const Dim &resizeDim)
 {
-    std::ofstream fpOut(szOutFilePath, std::ios::out | std::ios::binary);
-    if (!fpOut)
+    Demuxer demuxer(szInFilePath);
+    demuxer.StartPrefetch();
+    NvDecoder dec(cuContext, demuxer.GetWidth(), demuxer.GetHeight(), false, FFmpeg2NvCodecId(demuxer.GetVideoCodec()), NULL, false, false, &cropRect, &resizeDim);
+
+    // Frames are written on a background thread and stay locked in the decoder until written
+    AsyncFrameWriter writer(szOutFilePath, bDirectIo);
+    if (!writer.IsOpen())
     {
         std::ostringstream err;
         err << "Unable to open output file: " << szOutFilePath << std::endl;
         throw std::invalid_argument(err.str());
     }
-
-    FFmpegDemuxer demuxer(szInFilePath);
-    NvDecoder dec(cuContext, demuxer.GetWidth(), demuxer.GetHeight(), false, FFmpeg2NvCodecId(demuxer.GetVideoCodec()), NULL, false, false, &cropRect, &resizeDim);
+    // Y4M output is chosen by the file extension; Y4M frames are always planar
+    const char *szExt = strrchr(szOutFilePath, '.');
+    bool bY4m = szExt && !_stricmp(szExt, ".y4m");
+    bOutPlanar = bOutPlanar || bY4m;
 
     int nVideoBytes = 0, nFrameReturned = 0, nFrame = 0;
     uint8_t *pVideo = NULL, **ppFrame;
     do {
         demuxer.Demux(&pVideo, &nVideoBytes);
-        dec.Decode(pVideo, nVideoBytes, &ppFrame, &nFrameReturned);
+        dec.DecodeLockFrame(pVideo, nVideoBytes, &ppFrame, &nFrameReturned);
         if (!nFrame && nFrameReturned)
             LOG(INFO) << dec.GetVideoInfo();
+        if (bY4m && !nFrame && nFrameReturned) {
+            Y4mInfo y4mInfo;
+            y4mInfo.nWidth = dec.GetWidth();
+            y4mInfo.nHeight = dec.GetHeight();
+            y4mInfo.nBitDepth = dec.GetBitDepth() == 8 ? 8 : 16;
+            demuxer.GetFrameRate(&y4mInfo.nFrameRateNum, &y4mInfo.nFrameRateDen);
+            std::string header = y4mInfo.GetHeader();
+            writer.WriteCopy(header.data(), (int)header.size());
+        }
 
         for (int i = 0; i < nFrameReturned; i++) {
             if (bOutPlanar) {
                 ConvertToPlanar(ppFrame[i], dec.GetWidth(), dec.GetHeight(), dec.GetBitDepth());
             }
-            fpOut.write(reinterpret_cast<char*>(ppFrame[i]), dec.GetFrameSize());
+            if (bY4m) {
+                writer.WriteCopy("FRAME\n", 6);
+            }
+            writer.Write(ppFrame[i], dec.GetFrameSize(), [&dec](uint8_t *pFrame) { dec.UnlockFrame(&pFrame, 1); });
         }
         nFrame += nFrameReturned;
     } while (nVideoBytes);
 
     std::cout << "Total frame decoded: " << nFrame << std::endl
             << "Saved in file " << szOutFilePath << " in "
-            << (dec.GetBitDepth() == 8 ? (bOutPlanar ? "iyuv" : "nv12") : (bOutPlanar ? "yuv420p16" : "p016"))
+            << (bY4m ? "y4m" : dec.GetBitDepth() == 8 ? (bOutPlanar ? "iyuv" : "nv12") : (bOutPlanar ? "yuv420p16" : "p016"))
             << " format" << std::endl;
-    fpOut.close();
+    writer.Close();
 }
 
 void ShowDecoderCapability() {
@@ -123,8 +147,9 @@ void ShowHelpAndExit(const char *szBadOption = NULL)
     }
     oss << "Options:" << std::endl
         << "-i             Input file path" << std::endl
-        << "-o             Output file path" << std::endl
+        << "-o             Output file path; a .y4m extension selects Y4M output" << std::endl
         << "-outplanar     Convert output to planar format" << std::endl
+        << "-directio      Write output with O_DIRECT, bypassing the page cache (Linux only)" << std::endl
         << "-gpu           Ordinal of GPU to use" << std::endl
         << "-crop l,t,r,b  Crop rectangle in left,top,right,bottom (ignored for case 0)" << std::endl
         << "-resize WxH    Resize to dimension W times H (ignored for case 0)" << std::endl
@@ -143,7 +168,7 @@ void ShowHelpAndExit(const char *szBadOption = NULL)
 }
 
 void ParseCommandLine(int argc, char *argv[], char *szInputFileName, char *szOutputFileName,
-    bool &bOutPlanar, int &iGpu, Rect &cropRect, Dim &resizeDim)
+    bool &bOutPlanar, bool &bDirectIo, int &iGpu, Rect &cropRect, Dim &resizeDim)
 {
     std::ostringstream oss;
     int i;
@@ -169,6 +194,10 @@ void ParseCommandLine(int argc, char *argv[], char *szInputFileName, char *szOut
             bOutPlanar = true;
             continue;
         }
+        if (!_stricmp(argv[i], "-directio")) {
+            bDirectIo = true;
+            continue;
+        }
         if (!_stricmp(argv[i], "-gpu")) {
             if (++i == argc) {
                 ShowHelpAndExit("-gpu");
@@ -212,12 +241,13 @@ int main(int argc, char **argv)
 {
     char szInFilePath[256] = "", szOutFilePath[256] = "";
     bool bOutPlanar = false;
+    bool bDirectIo = false;
     int iGpu = 0;
     Rect cropRect = {};
     Dim resizeDim = {};
     try
     {
-        ParseCommandLine(argc, argv, szInFilePath, szOutFilePath, bOutPlanar, iGpu, cropRect, resizeDim);
+        ParseCommandLine(argc, argv, szInFilePath, szOutFilePath, bOutPlanar, bDirectIo, iGpu, cropRect, resizeDim);
         CheckInputFile(szInFilePath);
 
         if (!*szOutFilePath) {
@@ -240,7 +270,12 @@ int main(int argc, char **argv)
         ck(cuCtxCreate(&cuContext, 0, cuDevice));
 
         std::cout << "Decode with demuxing." << std::endl;
-        DecodeMediaFile(cuContext, szInFilePath, szOutFilePath, bOutPlanar, cropRect, resizeDim);
+        // Raw elementary streams are split into access units directly, without libavformat
+        if (ElementaryStreamDemuxer::IsElementaryStreamFile(szInFilePath)) {
+            DecodeMediaFile<ElementaryStreamDemuxer>(cuContext, szInFilePath, szOutFilePath, bOutPlanar, bDirectIo, cropRect, resizeDim);
+        } else {
+            DecodeMediaFile<FFmpegDemuxer>(cuContext, szInFilePath, szOutFilePath, bOutPlanar, bDirectIo, cropRect, resizeDim);
+        }
     }
     catch (const std::exception& ex)
     {
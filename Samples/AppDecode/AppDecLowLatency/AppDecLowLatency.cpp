@@ -13,6 +13,7 @@
 #include <cuda.h>
 #include "NvDecoder/NvDecoder.h"
 #include "../Utils/NvCodecUtils.h"
+#include "../Utils/RawFrameIO.h"
 #include "../Utils/FFmpegDemuxer.h"
 #include "../Common/AppDecUtils.h"
 
@@ -60,8 +61,9 @@ int main(int argc, char *argv[])
         int nFrame = 0;
         uint8_t *pVideo = NULL;
         int nVideoBytes = 0;
-        std::ofstream fpOut(szOutFilePath, std::ios::out | std::ios::binary);
-        if (!fpOut)
+        // Frames are written on a background thread and stay locked in the decoder until written
+        AsyncFrameWriter writer(szOutFilePath);
+        if (!writer.IsOpen())
         {
             std::ostringstream err;
             err << "Unable to open output file: " << szOutFilePath << std::endl;
@@ -76,7 +78,7 @@ int main(int argc, char *argv[])
         do {
             demuxer.Demux(&pVideo, &nVideoBytes);
             // Set flag CUVID_PKT_ENDOFPICTURE to signal that a complete packet has been sent to decode
-            dec.Decode(pVideo, nVideoBytes, &ppFrame, &nFrameReturned, CUVID_PKT_ENDOFPICTURE, &pTimestamp, n++);
+            dec.DecodeLockFrame(pVideo, nVideoBytes, &ppFrame, &nFrameReturned, CUVID_PKT_ENDOFPICTURE, &pTimestamp, n++);
             if (!nFrame && nFrameReturned)
                 LOG(INFO) << dec.GetVideoInfo();
 
@@ -96,11 +98,11 @@ int main(int argc, char *argv[])
                 {
                     std::cout << "Timestamp: " << pTimestamp[i] << std::endl;
                 }
-                fpOut.write(reinterpret_cast<char*>(ppFrame[i]), dec.GetFrameSize());
+                writer.Write(ppFrame[i], dec.GetFrameSize(), [&dec](uint8_t *pFrame) { dec.UnlockFrame(&pFrame, 1); });
             }
         } while (nVideoBytes);
 
-        fpOut.close();
+        writer.Close();
         std::cout << "One packet in and one frame out: " << (bOneInOneOut ? "true" : "false") << std::endl;
     }
     catch(const std::exception& ex)
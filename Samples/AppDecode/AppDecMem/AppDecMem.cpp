@@ -13,33 +13,11 @@
 #include "NvDecoder/NvDecoder.h"
 #include "../Utils/NvCodecUtils.h"
 #include "../Utils/FFmpegDemuxer.h"
+#include "../Utils/MmapDataProvider.h"
 #include "../Common/AppDecUtils.h"
 
 simplelogger::Logger *logger = simplelogger::LoggerFactory::CreateConsoleLogger();
 
-class FileDataProvider : public FFmpegDemuxer::DataProvider {
-public:
-    FileDataProvider(const char *szInFilePath) {
-        fpIn.open(szInFilePath, std::ifstream::in | std::ifstream::binary);
-        if (!fpIn)
-        {
-            std::cout << "Unable to open input file: " << szInFilePath << std::endl;
-            return;
-        }
-    }
-    ~FileDataProvider() {
-        fpIn.close();
-    }
-    // Fill in the buffer owned by the demuxer/decoder
-    int GetData(uint8_t *pBuf, int nBuf) {
-        // We read a file for this example. You may get your data from network or somewhere else
-        return (int)fpIn.read(reinterpret_cast<char*>(pBuf), nBuf).gcount();
-    }
-
-private:
-    std::ifstream fpIn;
-};
-
 /**
 *  This sample application illustrates shows how to demux and decode media content from
 *  memory buffer.
@@ -71,11 +49,13 @@ int main(int argc, char *argv[])
         CUcontext cuContext = NULL;
         ck(cuCtxCreate(&cuContext, 0, cuDevice));
 
-        FileDataProvider dp(szInFilePath);
-        /* Instead of passing in a media file path, here we pass in a DataProvider, which reads from the file.
-           Note that the data is passed into the demuxer chunk-by-chunk sequentially. If the meta data is at the end of the file
-           (as for MP4) and the buffer isn't large enough to hold the whole file, the file may never get demuxed.*/
-        FFmpegDemuxer demuxer(&dp);
+        MmapDataProvider dp(szInFilePath);
+        /* Instead of passing in a media file path, here we pass in a DataProvider, which serves the memory-mapped file.
+           You may get your data from network or somewhere else by implementing your own DataProvider.
+           Note that the data is passed into the demuxer chunk-by-chunk. If the meta data is at the end of the file
+           (as for MP4), the DataProvider has to implement Seek() and GetSize(); otherwise the file may never get demuxed
+           unless the buffer is large enough to hold the whole file. As MmapDataProvider can seek, a small buffer is enough.*/
+        FFmpegDemuxer demuxer(&dp, 256 * 1024);
         NvDecoder dec(cuContext, demuxer.GetWidth(), demuxer.GetHeight(), false, FFmpeg2NvCodecId(demuxer.GetVideoCodec()));
 
         int nFrame = 0;
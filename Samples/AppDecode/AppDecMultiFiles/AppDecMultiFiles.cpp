@@ -19,6 +19,7 @@
 #include <string>
 #include "NvDecoder/NvDecoder.h"
 #include "../Utils/NvCodecUtils.h"
+#include "../Utils/RawFrameIO.h"
 #include "../Utils/FFmpegDemuxer.h"
 
 simplelogger::Logger *logger = simplelogger::LoggerFactory::CreateConsoleLogger();
@@ -60,15 +61,19 @@ void getMaxWidthandMaxHeight(int &maxWidth, int &maxHeight, cudaVideoCodec aeCod
 
 void DecodeMediaFile(CUcontext cuContext, NvDecoder **pDec, FILEINFO fileData, int useReconfigure, int maxWidth = 0, int maxHeight = 0)
 {
-    std::ofstream fpOut(fileData.outFile, std::ios::out | std::ios::binary);
-    if (!fpOut)
+    // Frames are written on a background thread and stay locked in the decoder until written
+    AsyncFrameWriter writer(fileData.outFile);
+    if (!writer.IsOpen())
     {
         std::ostringstream err;
         err << "Unable to open output file: " << fileData.outFile << std::endl;
         throw std::invalid_argument(err.str());
     }
 
-    FFmpegDemuxer demuxer(fileData.inFile);
+    // Files in a batch usually share their format, so bound the probing and reuse the stream info
+    FFmpegDemuxer::OpenOptions openOptions;
+    openOptions.bFastOpen = true;
+    FFmpegDemuxer demuxer(fileData.inFile, openOptions);
     NvDecoder *dec = *pDec;
 
     if (useReconfigure)
@@ -101,7 +106,7 @@ void DecodeMediaFile(CUcontext cuContext, NvDecoder **pDec, FILEINFO fileData, i
     uint8_t *pVideo = NULL, **ppFrame;
     do {
         demuxer.Demux(&pVideo, &nVideoBytes);
-        dec->Decode(pVideo, nVideoBytes, &ppFrame, &nFrameReturned);
+        dec->DecodeLockFrame(pVideo, nVideoBytes, &ppFrame, &nFrameReturned);
         if (!nFrame && nFrameReturned)
             LOG(INFO) << dec->GetVideoInfo();
 
@@ -109,7 +114,7 @@ void DecodeMediaFile(CUcontext cuContext, NvDecoder **pDec, FILEINFO fileData, i
             if (fileData.outplanar) {
                 ConvertToPlanar(ppFrame[i], dec->GetWidth(), dec->GetHeight(), dec->GetBitDepth());
             }
-            fpOut.write(reinterpret_cast<char*>(ppFrame[i]), dec->GetFrameSize());
+            writer.Write(ppFrame[i], dec->GetFrameSize(), [dec](uint8_t *pFrame) { dec->UnlockFrame(&pFrame, 1); });
         }
         nFrame += nFrameReturned;
     } while (nVideoBytes);
@@ -118,12 +123,13 @@ void DecodeMediaFile(CUcontext cuContext, NvDecoder **pDec, FILEINFO fileData, i
             << "Saved in file " << fileData.outFile << " in "
             << (dec->GetBitDepth() == 8 ? (fileData.outplanar ? "iyuv" : "nv12") : (fileData.outplanar ? "yuv420p16" : "p016"))
             << " format" << std::endl;
+    // All frames have to be back in the decoder before it's reconfigured or deleted
+    writer.Close();
     if (!useReconfigure)
     {
         delete dec;
         dec = NULL;
     }
-    fpOut.close();
 }
 
 void ShowDecoderCapability() {
@@ -20,18 +20,25 @@
 #include "NvDecoder/NvDecoder.h"
 #include "../Utils/NvCodecUtils.h"
 #include "../Utils/FFmpegDemuxer.h"
+#include "../Utils/ElementaryStreamDemuxer.h"
 
 simplelogger::Logger *logger = simplelogger::LoggerFactory::CreateConsoleLogger();
 
-void DecProc(NvDecoder *pDec, FFmpegDemuxer *demuxer, int *pnFrame, std::exception_ptr &ex)
+template <typename Demuxer>
+void DecProc(NvDecoder *pDec, Demuxer *demuxer, int *pnFrame, std::exception_ptr &ex)
 {
     try
     {
         int nVideoBytes = 0, nFrameReturned = 0, nFrame = 0;
         uint8_t *pVideo = NULL, **ppFrame = NULL;
 
+        // H.264/HEVC packets form an Annex-B stream, so a batch of them can be parsed in one Decode() call
+        bool bBatch = demuxer->GetVideoCodec() == AV_CODEC_ID_H264 || demuxer->GetVideoCodec() == AV_CODEC_ID_HEVC;
         do {
-            demuxer->Demux(&pVideo, &nVideoBytes);
+            if (bBatch)
+                demuxer->DemuxBatch(&pVideo, &nVideoBytes, NULL, 16, 4 * 1024 * 1024);
+            else
+                demuxer->Demux(&pVideo, &nVideoBytes);
             pDec->Decode(pVideo, nVideoBytes, &ppFrame, &nFrameReturned);
             if (!nFrame && nFrameReturned)
                 LOG(INFO) << pDec->GetVideoInfo();
@@ -61,6 +68,7 @@ void ShowHelpAndExit(const char *szBadOption = NULL)
         << "-thread      Number of decoding thread" << std::endl
         << "-single      (No value) Use single context (this may result in suboptimal performance; default is multiple contexts)" << std::endl
         << "-host        (No value) Copy frame to host memory (this may result in suboptimal performance; default is device memory)" << std::endl
+        << "-ffmpeg      (No value) Demux raw H.264/HEVC files with FFmpeg instead of the built-in elementary stream demuxer" << std::endl
         ;
     if (bThrowError)
     {
@@ -73,7 +81,7 @@ void ShowHelpAndExit(const char *szBadOption = NULL)
     }
 }
 
-void ParseCommandLine(int argc, char *argv[], char *szInputFileName, int &iGpu, int &nThread, bool &bSingle, bool &bHost) 
+void ParseCommandLine(int argc, char *argv[], char *szInputFileName, int &iGpu, int &nThread, bool &bSingle, bool &bHost, bool &bFFmpeg) 
 {
     for (int i = 1; i < argc; i++) {
         if (!_stricmp(argv[i], "-h")) {
@@ -108,6 +116,10 @@ void ParseCommandLine(int argc, char *argv[], char *szInputFileName, int &iGpu,
             bHost = true;
             continue;
         }
+        if (!_stricmp(argv[i], "-ffmpeg")) {
+            bFFmpeg = true;
+            continue;
+        }
         ShowHelpAndExit(argv[i]);
     }
 }
@@ -128,6 +140,62 @@ int CUDAAPI HandleVideoData(void *pUserData, CUVIDSOURCEDATAPACKET *pPacket) {
     return 1;
 }
 
+/**
+*   @brief  Opens a demuxer and a decoder per thread, then decodes the file on all threads at once.
+*   Returns the total number of frames decoded; the time spent opening the demuxers, which is
+*   where libavformat probing shows up, and the decoding time are returned separately.
+*/
+template <typename Demuxer>
+int DecodeOnThreads(const char *szInFilePath, CUdevice cuDevice, int nThread, bool bSingle, bool bHost,
+    std::vector<std::exception_ptr> &vExceptionPtrs, double *pOpenSec, double *pDecodeSec)
+{
+    std::vector<std::unique_ptr<Demuxer>> vDemuxer;
+    std::vector<std::unique_ptr<NvDecoder>> vDec;
+    CUcontext cuContext = NULL;
+    ck(cuCtxCreate(&cuContext, 0, cuDevice));
+    vExceptionPtrs.resize(nThread);
+    std::mutex m;
+    StopWatch watch;
+    *pOpenSec = 0;
+    for (int i = 0; i < nThread; i++)
+    {
+        if (!bSingle)
+        {
+            ck(cuCtxCreate(&cuContext, 0, cuDevice));
+        }
+        watch.Start();
+        std::unique_ptr<Demuxer> demuxer(new Demuxer(szInFilePath));
+        demuxer->StartPrefetch();
+        *pOpenSec += watch.Stop();
+        std::unique_ptr<NvDecoder> dec(new NvDecoder(cuContext, demuxer->GetWidth(), demuxer->GetHeight(), !bHost, FFmpeg2NvCodecId(demuxer->GetVideoCodec()), bSingle ? &m : NULL));
+        vDemuxer.push_back(std::move(demuxer));
+        vDec.push_back(std::move(dec));
+    }
+
+    std::vector<NvThread> vThread;
+    std::vector<int> vnFrame;
+    vnFrame.resize(nThread, 0);
+
+    watch.Start();
+    for (int i = 0; i < nThread; i++)
+    {
+        vThread.push_back(NvThread(std::thread(DecProc<Demuxer>, vDec[i].get(), vDemuxer[i].get(), &vnFrame[i], std::ref(vExceptionPtrs[i]))));
+    }
+    for (int i = 0; i < nThread; i++)
+    {
+        vThread[i].join();
+    }
+    *pDecodeSec = watch.Stop();
+
+    int nTotal = 0;
+    for (int i = 0; i < nThread; i++)
+    {
+        nTotal += vnFrame[i];
+        vDec[i].reset(nullptr);
+    }
+    return nTotal;
+}
+
 /**
 *  This sample application measures decoding performance in FPS.
 *  The application creates multiple host threads and runs a different decoding session
@@ -145,10 +213,11 @@ int main(int argc, char **argv)
     int nThread = 1; 
     bool bSingle = false;
     bool bHost = false;
+    bool bFFmpeg = false;
     std::vector<std::exception_ptr> vExceptionPtrs;
     try
     {
-        ParseCommandLine(argc, argv, szInFilePath, iGpu, nThread, bSingle, bHost);
+        ParseCommandLine(argc, argv, szInFilePath, iGpu, nThread, bSingle, bHost, bFFmpeg);
         CheckInputFile(szInFilePath);
 
         struct stat st;
@@ -183,46 +252,17 @@ int main(int argc, char **argv)
         ck(cuDeviceGetName(szDeviceName, sizeof(szDeviceName), cuDevice));
         std::cout << "GPU in use: " << szDeviceName << std::endl;
 
-        std::vector<std::unique_ptr<FFmpegDemuxer>> vDemuxer;
-        std::vector<std::unique_ptr<NvDecoder>> vDec;
-        CUcontext cuContext = NULL;
-        ck(cuCtxCreate(&cuContext, 0, cuDevice));
-        vExceptionPtrs.resize(nThread);
-        std::mutex m;
-        for (int i = 0; i < nThread; i++)
-        {
-            if (!bSingle)
-            {
-                ck(cuCtxCreate(&cuContext, 0, cuDevice));
-            }
-            std::unique_ptr<FFmpegDemuxer> demuxer(new FFmpegDemuxer(szInFilePath));
-            std::unique_ptr<NvDecoder> dec(new NvDecoder(cuContext, demuxer->GetWidth(), demuxer->GetHeight(), !bHost, FFmpeg2NvCodecId(demuxer->GetVideoCodec()), bSingle ? &m : NULL));
-            vDemuxer.push_back(std::move(demuxer));
-            vDec.push_back(std::move(dec));
-        }
-
-        std::vector<NvThread> vThread;
-        std::vector<int> vnFrame;
-        vnFrame.resize(nThread, 0);
-
-        StopWatch watch;
-        watch.Start();
-        for (int i = 0; i < nThread; i++)
-        {
-            vThread.push_back(NvThread(std::thread(DecProc, vDec[i].get(), vDemuxer[i].get(), &vnFrame[i], std::ref(vExceptionPtrs[i]))));
-        }
-        for (int i = 0; i < nThread; i++)
+        double openSec = 0, sec = 0;
+        int nTotal = 0;
+        if (!bFFmpeg && ElementaryStreamDemuxer::IsElementaryStreamFile(szInFilePath))
         {
-            vThread[i].join();
+            nTotal = DecodeOnThreads<ElementaryStreamDemuxer>(szInFilePath, cuDevice, nThread, bSingle, bHost, vExceptionPtrs, &openSec, &sec);
         }
-        double sec = watch.Stop();
-
-        int nTotal = 0;
-        for (int i = 0; i < nThread; i++)
+        else
         {
-            nTotal += vnFrame[i];
-            vDec[i].reset(nullptr);
+            nTotal = DecodeOnThreads<FFmpegDemuxer>(szInFilePath, cuDevice, nThread, bSingle, bHost, vExceptionPtrs, &openSec, &sec);
         }
+        std::cout << "Demuxer open time=" << openSec * 1000 / nThread << " ms per thread" << std::endl;
         std::cout << "Total Frames Decoded=" << nTotal << ", time=" << sec << " seconds, FPS=" << (nTotal / sec) << std::endl;
 
         ck(cuProfilerStop());
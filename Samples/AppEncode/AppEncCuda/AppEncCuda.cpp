@@ -17,20 +17,13 @@
 #include "../Utils/Logger.h"
 #include "../Utils/NvEncoderCLIOptions.h"
 #include "../Utils/NvCodecUtils.h"
+#include "../Utils/RawFrameIO.h"
 
 simplelogger::Logger *logger = simplelogger::LoggerFactory::CreateConsoleLogger();
 
 void EncodeCuda(CUcontext cuContext, char *szInFilePath, int nWidth, int nHeight, NV_ENC_BUFFER_FORMAT eFormat,
     char *szOutFilePath, NvEncoderInitParam *pEncodeCLIOptions)
 {
-    std::ifstream fpIn(szInFilePath, std::ifstream::in | std::ifstream::binary);
-    if (!fpIn)
-    {
-        std::ostringstream err;
-        err << "Unable to open input file: " << szInFilePath << std::endl;
-        throw std::invalid_argument(err.str());
-    }
-
     std::ofstream fpOut(szOutFilePath, std::ios::out | std::ios::binary);
     if (!fpOut)
     {
@@ -52,18 +45,25 @@ void EncodeCuda(CUcontext cuContext, char *szInFilePath, int nWidth, int nHeight
 
     int nFrameSize = enc.GetFrameSize();
 
-    std::unique_ptr<uint8_t[]> pHostFrame(new uint8_t[nFrameSize]);
+    // Frames are read ahead on a background thread, so encoding doesn't wait on disk
+    RawFrameReader frameReader(szInFilePath, nFrameSize);
+    if (!frameReader.IsOpen())
+    {
+        std::ostringstream err;
+        err << "Unable to open input file: " << szInFilePath << std::endl;
+        throw std::invalid_argument(err.str());
+    }
     int nFrame = 0;
     while (true)
     {
-        // Load the next frame from disk
-        std::streamsize nRead = fpIn.read(reinterpret_cast<char*>(pHostFrame.get()), nFrameSize).gcount();
+        // Take the next frame read from disk
+        uint8_t *pHostFrame = frameReader.ReadFrame();
         // For receiving encoded packets
         std::vector<std::vector<uint8_t>> vPacket;
-        if (nRead == nFrameSize)
+        if (pHostFrame)
         {
             const NvEncInputFrame* encoderInputFrame = enc.GetNextInputFrame();
-            NvEncoderCuda::CopyToDeviceFrame(cuContext, pHostFrame.get(), 0, (CUdeviceptr)encoderInputFrame->inputPtr,
+            NvEncoderCuda::CopyToDeviceFrame(cuContext, pHostFrame, 0, (CUdeviceptr)encoderInputFrame->inputPtr,
                 (int)encoderInputFrame->pitch,
                 enc.GetEncodeWidth(),
                 enc.GetEncodeHeight(), 
@@ -85,12 +85,11 @@ void EncodeCuda(CUcontext cuContext, char *szInFilePath, int nWidth, int nHeight
             fpOut.write(reinterpret_cast<char*>(packet.data()), packet.size());
         }
 
-        if (nRead != nFrameSize) break;
+        if (!pHostFrame) break;
     }
 
     enc.DestroyEncoder();
     fpOut.close();
-    fpIn.close();
 
     std::cout << "Total frames encoded: " << nFrame << std::endl << "Saved in file " << szOutFilePath << std::endl;
 }
@@ -144,9 +143,9 @@ void ShowHelpAndExit(const char *szBadOption = NULL)
         oss << "Error parsing \"" << szBadOption << "\"" << std::endl;
     }
     oss << "Options:" << std::endl
-        << "-i           Input file path" << std::endl
+        << "-i           Input file path, raw or Y4M" << std::endl
         << "-o           Output file path" << std::endl
-        << "-s           Input resolution in this form: WxH" << std::endl
+        << "-s           Input resolution in this form: WxH (taken from the header for Y4M)" << std::endl
         << "-if          Input format: iyuv nv12 yuv444 p010 yuv444p16 bgra bgra10 ayuv abgr abgr10" << std::endl
         << "-gpu         Ordinal of GPU to use" << std::endl
         ;
@@ -276,6 +275,19 @@ int main(int argc, char **argv)
 
         CheckInputFile(szInFilePath);
 
+        // Y4M input carries its resolution and format, which take precedence over -s and -if
+        Y4mInfo y4mInfo;
+        if (y4mInfo.ParseFile(szInFilePath))
+        {
+            nWidth = y4mInfo.nWidth;
+            nHeight = y4mInfo.nHeight;
+            if (!GetY4mEncodeFormat(y4mInfo, &eFormat))
+            {
+                std::cout << "Unsupported Y4M color space" << std::endl;
+                return 1;
+            }
+        }
+
         if (!*szOutFilePath)
         {
             sprintf(szOutFilePath, encodeCLIOptions.IsCodecH264() ? "out.h264" : "out.hevc");
@@ -21,6 +21,7 @@
 #include "NvEncoder/NvEncoderCuda.h"
 #include "../Utils/NvEncoderCLIOptions.h"
 #include "../Utils/NvCodecUtils.h"
+#include "../Utils/RawFrameIO.h"
 #include "../Utils/FFmpegStreamer.h"
 #include "../Utils/FFmpegDemuxer.h"
 
@@ -183,36 +184,35 @@ void EncodeProc(CUdevice cuDevice, int nWidth, int nHeight, NV_ENC_BUFFER_FORMAT
 
         enc.CreateEncoder(&initializeParams);
 
-        std::ifstream fpIn(szInFilePath, std::ifstream::in | std::ifstream::binary);
-        if (!fpIn)
+        int nHostFrameSize = bBgra64 ? nWidth * nHeight * 8 : enc.GetFrameSize();
+        // Frames are read ahead on a background thread, so encoding doesn't wait on disk
+        RawFrameReader frameReader(szInFilePath, nHostFrameSize);
+        if (!frameReader.IsOpen())
         {
             std::cout << "Unable to open input file: " << szInFilePath << std::endl;
             return;
         }
-
-        int nHostFrameSize = bBgra64 ? nWidth * nHeight * 8 : enc.GetFrameSize();
-        std::unique_ptr<uint8_t[]> pHostFrame(new uint8_t[nHostFrameSize]);
+        uint8_t *pHostFrame = NULL;
         CUdeviceptr dpBgraFrame = 0;
         ck(cuMemAlloc(&dpBgraFrame, nWidth * nHeight * 8));
         int nFrame = 0;
-        std::streamsize nRead = 0;
         FFmpegStreamer streamer(pEncodeCLIOptions->IsCodecH264() ? AV_CODEC_ID_H264 : AV_CODEC_ID_HEVC, nWidth, nHeight, 25, szMediaPath);
         do {
             std::vector<std::vector<uint8_t>> vPacket;
-            nRead = fpIn.read(reinterpret_cast<char*>(pHostFrame.get()), nHostFrameSize).gcount();
-            if (nRead == nHostFrameSize)
+            pHostFrame = frameReader.ReadFrame();
+            if (pHostFrame)
             {
                 const NvEncInputFrame* encoderInputFrame = enc.GetNextInputFrame();
 
                 if (bBgra64)
                 {
                     // Color space conversion
-                    ck(cuMemcpyHtoD(dpBgraFrame, pHostFrame.get(), nHostFrameSize));
+                    ck(cuMemcpyHtoD(dpBgraFrame, pHostFrame, nHostFrameSize));
                     Bgra64ToP016((uint8_t *)dpBgraFrame, nWidth * 8, (uint8_t *)encoderInputFrame->inputPtr, encoderInputFrame->pitch, nWidth, nHeight);
                 }
                 else
                 {
-                    NvEncoderCuda::CopyToDeviceFrame(cuContext, pHostFrame.get(), 0, (CUdeviceptr)encoderInputFrame->inputPtr,
+                    NvEncoderCuda::CopyToDeviceFrame(cuContext, pHostFrame, 0, (CUdeviceptr)encoderInputFrame->inputPtr,
                         (int)encoderInputFrame->pitch,
                         enc.GetEncodeWidth(),
                         enc.GetEncodeHeight(),
@@ -230,12 +230,11 @@ void EncodeProc(CUdevice cuDevice, int nWidth, int nHeight, NV_ENC_BUFFER_FORMAT
             for (std::vector<uint8_t> &packet : vPacket) {
                 streamer.Stream(packet.data(), (int)packet.size(), nFrame++);
             }
-        } while (nRead == nHostFrameSize);
+        } while (pHostFrame);
         ck(cuMemFree(dpBgraFrame));
         dpBgraFrame = 0;
 
         enc.DestroyEncoder();
-        fpIn.close();
 
         std::cout << std::flush << "Total frames encoded: " << nFrame << std::endl << std::flush;
     }
@@ -17,20 +17,13 @@
 #include "../Utils/Logger.h"
 #include "../Utils/NvEncoderCLIOptions.h"
 #include "../Utils/NvCodecUtils.h"
+#include "../Utils/RawFrameIO.h"
 
 simplelogger::Logger *logger = simplelogger::LoggerFactory::CreateConsoleLogger();
 
 void EncodeLowLatency(CUcontext cuContext, char *szInFilePath, int nWidth, int nHeight, NV_ENC_BUFFER_FORMAT eFormat,
     char *szOutFilePath, NvEncoderInitParam *pEncodeCLIOptions)
 {
-    std::ifstream fpIn(szInFilePath, std::ifstream::in | std::ifstream::binary);
-    if (!fpIn)
-    {
-        std::ostringstream err;
-        err << "Unable to open input file: " << szInFilePath << std::endl;
-        throw std::invalid_argument(err.str());
-    }
-
     std::ofstream fpOut(szOutFilePath, std::ios::out | std::ios::binary);
     if (!fpOut)
     {
@@ -71,21 +64,28 @@ void EncodeLowLatency(CUcontext cuContext, char *szInFilePath, int nWidth, int n
     NV_ENC_PIC_PARAMS picParams = {NV_ENC_PIC_PARAMS_VER};
     picParams.encodePicFlags = 0;
 
-    std::streamsize  nRead = 0;
     int nFrameSize = enc.GetFrameSize();
-    std::unique_ptr<uint8_t[]> pHostFrame(new uint8_t[nFrameSize]);
+    // Frames are read ahead on a background thread, so encoding doesn't wait on disk
+    RawFrameReader frameReader(szInFilePath, nFrameSize);
+    if (!frameReader.IsOpen())
+    {
+        std::ostringstream err;
+        err << "Unable to open input file: " << szInFilePath << std::endl;
+        throw std::invalid_argument(err.str());
+    }
+    uint8_t *pHostFrame = NULL;
 
 
     int nFrame = 0, i = 0;
     do
     {
         std::vector<std::vector<uint8_t>> vPacket;
-        nRead = fpIn.read(reinterpret_cast<char*>(pHostFrame.get()), nFrameSize).gcount();
-        if (nRead == nFrameSize) 
+        pHostFrame = frameReader.ReadFrame();
+        if (pHostFrame) 
         {
             const NvEncInputFrame* encoderInputFrame =  enc.GetNextInputFrame();
             NvEncoderCuda::CopyToDeviceFrame(cuContext,
-                pHostFrame.get(),
+                pHostFrame,
                 0, 
                 (CUdeviceptr)encoderInputFrame->inputPtr,
                 (int)encoderInputFrame->pitch,
@@ -124,11 +124,10 @@ void EncodeLowLatency(CUcontext cuContext, char *szInFilePath, int nWidth, int n
             fpOut.write(reinterpret_cast<char*>(packet.data()), packet.size());
         }
         i++;
-    } while (nRead == nFrameSize);
+    } while (pHostFrame);
 
     enc.DestroyEncoder();
     fpOut.close();
-    fpIn.close();
 
     std::cout << "Total frames encoded: " << nFrame << std::endl << "Saved in file " << szOutFilePath << std::endl;
 }
@@ -141,14 +140,6 @@ void EncodeLowLatencyDRC(CUcontext cuContext, char *szInFilePath, int nWidth, in
     CUdeviceptr dpInputChromaPlane = 0;
     try
     {
-        std::ifstream fpIn(szInFilePath, std::ifstream::in | std::ifstream::binary);
-        if (!fpIn)
-        {
-            std::ostringstream err;
-            err << "Unable to open input file: " << szInFilePath << std::endl;
-            throw std::invalid_argument(err.str());
-        }
-
         std::ofstream fpOut(szOutFilePath, std::ios::out | std::ios::binary);
         if (!fpOut)
         {
@@ -199,9 +190,16 @@ void EncodeLowLatencyDRC(CUcontext cuContext, char *szInFilePath, int nWidth, in
         NV_ENC_PIC_PARAMS picParams = { NV_ENC_PIC_PARAMS_VER };
         picParams.encodePicFlags = 0;
 
-        std::streamsize  nRead = 0;
         int nFrameSize = enc.GetFrameSize();
-        std::unique_ptr<uint8_t[]> pHostFrame(new uint8_t[nFrameSize]);
+        // Frames are read ahead on a background thread, so encoding doesn't wait on disk
+        RawFrameReader frameReader(szInFilePath, nFrameSize);
+        if (!frameReader.IsOpen())
+        {
+            std::ostringstream err;
+            err << "Unable to open input file: " << szInFilePath << std::endl;
+            throw std::invalid_argument(err.str());
+        }
+        uint8_t *pHostFrame = NULL;
 
 
         size_t inputYPlanePitch = 0;
@@ -230,8 +228,8 @@ void EncodeLowLatencyDRC(CUcontext cuContext, char *szInFilePath, int nWidth, in
         do
         {
             std::vector<std::vector<uint8_t>> vPacket;
-            nRead = fpIn.read(reinterpret_cast<char*>(pHostFrame.get()), nFrameSize).gcount();
-            if (nRead == nFrameSize)
+            pHostFrame = frameReader.ReadFrame();
+            if (pHostFrame)
             {
                 const NvEncInputFrame* encoderInputFrame = enc.GetNextInputFrame();
                 if (i && i % 100 == 0)
@@ -266,7 +264,7 @@ void EncodeLowLatencyDRC(CUcontext cuContext, char *szInFilePath, int nWidth, in
                 if ((curEncodeWidth != initializeParams.encodeWidth) || (curEncodeHeight != initializeParams.encodeHeight))
                 {
                     NvEncoderCuda::CopyToDeviceFrame(cuContext,
-                        pHostFrame.get(),
+                        pHostFrame,
                         0,
                         dpInputYPlane,
                         (uint32_t)inputYPlanePitch,
@@ -298,7 +296,7 @@ void EncodeLowLatencyDRC(CUcontext cuContext, char *szInFilePath, int nWidth, in
                 else
                 {
                     NvEncoderCuda::CopyToDeviceFrame(cuContext,
-                        pHostFrame.get(),
+                        pHostFrame,
                         0,
                         (CUdeviceptr)encoderInputFrame->inputPtr,
                         (int)encoderInputFrame->pitch,
@@ -321,7 +319,7 @@ void EncodeLowLatencyDRC(CUcontext cuContext, char *szInFilePath, int nWidth, in
                 fpOut.write(reinterpret_cast<char*>(packet.data()), packet.size());
             }
             i++;
-        } while (nRead == nFrameSize);
+        } while (pHostFrame);
 
         cuMemFree(dpInputYPlane);
         dpInputYPlane = 0;
@@ -329,7 +327,6 @@ void EncodeLowLatencyDRC(CUcontext cuContext, char *szInFilePath, int nWidth, in
         dpInputChromaPlane = 0;
         enc.DestroyEncoder();
         fpOut.close();
-        fpIn.close();
 
         std::cout << "Total frames encoded: " << nFrame << std::endl << "Saved in file " << szOutFilePath << std::endl;
     }
@@ -351,9 +348,9 @@ void ShowHelpAndExit(const char *szBadOption = NULL)
         bThrowError = true;
     }
     oss << "Options:" << std::endl
-        << "-i           Input file path" << std::endl
+        << "-i           Input file path, raw or Y4M" << std::endl
         << "-o           Output file path" << std::endl
-        << "-s           Input resolution in this form: WxH" << std::endl
+        << "-s           Input resolution in this form: WxH (taken from the header for Y4M)" << std::endl
         << "-if          Input format: iyuv nv12" << std::endl
         << "-gpu         Ordinal of GPU to use" << std::endl
         << "-case        0: Encode frames with dynamic bitrate change" << std::endl
@@ -493,6 +490,19 @@ int main(int argc, char **argv)
 
         CheckInputFile(szInFilePath);
 
+        // Y4M input carries its resolution and format, which take precedence over -s and -if
+        Y4mInfo y4mInfo;
+        if (y4mInfo.ParseFile(szInFilePath))
+        {
+            nWidth = y4mInfo.nWidth;
+            nHeight = y4mInfo.nHeight;
+            if (!GetY4mEncodeFormat(y4mInfo, &eFormat) || eFormat != NV_ENC_BUFFER_FORMAT_IYUV)
+            {
+                std::cout << "Unsupported Y4M color space" << std::endl;
+                return 1;
+            }
+        }
+
         if (!*szOutFilePath) {
             sprintf(szOutFilePath, encodeCLIOptions.IsCodecH264() ? "out.h264" : "out.hevc");
         }
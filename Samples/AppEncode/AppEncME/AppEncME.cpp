@@ -33,18 +33,15 @@ void MotionEstimationWithBufferedFile(NvEncoderCuda *pEnc, int nWidth, int nHeig
         throw std::invalid_argument(err.str());
     }
 
-    uint8_t *pBuf = NULL;
-    uint32_t nBufSize = 0;
     BufferedFileReader bufferedFileReader(szInFilePath);
-    if (!bufferedFileReader.GetBuffer(&pBuf, &nBufSize)) {
+    bufferedFileReader.SetFrameLayout(pEnc->GetFrameSize());
+    uint32_t n = static_cast<uint32_t>(bufferedFileReader.GetFrameCount());
+    if (!n) {
         std::ostringstream err;
         err << "Failed to read file " << szInFilePath << std::endl;
         throw std::invalid_argument(err.str());
     }
 
-    uint64_t nFrameSize = pEnc->GetFrameSize();
-    uint32_t n = static_cast<uint32_t>(nBufSize / nFrameSize);
-
     if (nFrame == 0)
     {
         nFrame = n - 1;
@@ -67,10 +64,11 @@ void MotionEstimationWithBufferedFile(NvEncoderCuda *pEnc, int nWidth, int nHeig
 
         const NvEncInputFrame* inputFrame = pEnc->GetNextInputFrame();
         const NvEncInputFrame* referenceFrame = pEnc->GetNextReferenceFrame();
+        BufferedFileReader::FrameView input = bufferedFileReader.GetFrame(iFrame), reference = bufferedFileReader.GetFrame(iReferenceFrame);
 
         NvEncoderCuda::CopyToDeviceFrame(reinterpret_cast<CUcontext>(pEnc->GetDevice()),
-            (uint8_t *)pBuf + iFrame * nFrameSize,
-            0, 
+            (uint8_t *)input.pData,
+            input.nPitch, 
             (CUdeviceptr)inputFrame->inputPtr,
             (uint32_t)inputFrame->pitch,
             pEnc->GetEncodeWidth(),
@@ -81,8 +79,8 @@ void MotionEstimationWithBufferedFile(NvEncoderCuda *pEnc, int nWidth, int nHeig
             inputFrame->numChromaPlanes);
 
         NvEncoderCuda::CopyToDeviceFrame(reinterpret_cast<CUcontext>(pEnc->GetDevice()),
-            (uint8_t *)pBuf + iReferenceFrame * nFrameSize,
-            0,
+            (uint8_t *)reference.pData,
+            reference.nPitch,
             (CUdeviceptr)referenceFrame->inputPtr,
             (uint32_t)referenceFrame->pitch,
             pEnc->GetEncodeWidth(),
@@ -146,9 +144,9 @@ void ShowHelpAndExit(const char *szBadOption = NULL)
         oss << "Error parsing \"" << szBadOption << "\"" << std::endl;
     }
     oss << "Options:" << std::endl
-        << "-i           Input file path" << std::endl
+        << "-i           Input file path, raw or Y4M" << std::endl
         << "-o           Output file path" << std::endl
-        << "-s           Input resolution in this form: WxH" << std::endl
+        << "-s           Input resolution in this form: WxH (taken from the header for Y4M)" << std::endl
         << "-if          Input format: iyuv nv12 yuv444 p010 yuv444p16 bgra" << std::endl
         << "-gpu         Ordinal of GPU to use" << std::endl
         << "-frame       Number of frames to encode" << std::endl
@@ -298,6 +296,19 @@ int main(int argc, char **argv)
 
         CheckInputFile(szInFilePath);
 
+        // Y4M input carries its resolution and format, which take precedence over -s and -if
+        Y4mInfo y4mInfo;
+        if (y4mInfo.ParseFile(szInFilePath))
+        {
+            nWidth = y4mInfo.nWidth;
+            nHeight = y4mInfo.nHeight;
+            if (!GetY4mEncodeFormat(y4mInfo, &eFormat))
+            {
+                std::cout << "Unsupported Y4M color space" << std::endl;
+                return 1;
+            }
+        }
+
         ck(cuInit(0));
         int nGpu = 0;
         ck(cuDeviceGetCount(&nGpu));
@@ -21,7 +21,7 @@
 
 simplelogger::Logger *logger = simplelogger::LoggerFactory::CreateConsoleLogger();
 
-void EncProc(NvEncoder *pEnc, uint8_t *pBuf, uint32_t nBufSize, uint32_t nFrameTotal,
+void EncProc(NvEncoder *pEnc, uint8_t *pBuf, uint64_t nBufSize, uint32_t nFrameTotal,
     std::exception_ptr &encException)
 {
     try
@@ -56,6 +56,25 @@ void EncProc(NvEncoder *pEnc, uint8_t *pBuf, uint32_t nBufSize, uint32_t nFrameT
     }
 }
 
+/**
+*   @brief  Uploads nBufSize bytes of frame data. Y4M frames are copied one by one from their
+*   views, which leaves out the frame headers; raw files are copied as they are.
+*/
+void UploadFrames(CUdeviceptr dpBuf, BufferedFileReader &reader, const uint8_t *pBuf, uint64_t nBufSize)
+{
+    const Y4mInfo *pY4mInfo = reader.GetY4mInfo();
+    if (!pY4mInfo)
+    {
+        ck(cuMemcpyHtoD(dpBuf, pBuf, nBufSize));
+        return;
+    }
+    uint64_t nFrameSize = pY4mInfo->GetFrameSize();
+    for (uint64_t i = 0; (i + 1) * nFrameSize <= nBufSize; i++)
+    {
+        ck(cuMemcpyHtoD(dpBuf + i * nFrameSize, reader.GetFrame(i).pData, nFrameSize));
+    }
+}
+
 void ShowHelpAndExit(const char *szBadOption = NULL)
 {
     bool bThrowError = false;
@@ -66,7 +85,7 @@ void ShowHelpAndExit(const char *szBadOption = NULL)
         oss << "Error parsing \"" << szBadOption << "\"" << std::endl;
     }
     oss << "Options:" << std::endl
-        << "-i           Input file path" << std::endl
+        << "-i           Input file path, raw or Y4M" << std::endl
         << "-s           Input resolution in this form: WxH" << std::endl
         << "-if          Input format: iyuv nv12 yuv444 p010 yuv444p16 bgra" << std::endl
         << "-gpu         Ordinal of GPU to use" << std::endl
@@ -230,6 +249,19 @@ int main(int argc, char **argv)
 
         CheckInputFile(szInFilePath);
 
+        // Y4M input carries its resolution and format, which take precedence over -s and -if
+        Y4mInfo y4mInfo;
+        if (y4mInfo.ParseFile(szInFilePath))
+        {
+            nWidth = y4mInfo.nWidth;
+            nHeight = y4mInfo.nHeight;
+            if (!GetY4mEncodeFormat(y4mInfo, &eFormat))
+            {
+                std::cout << "Unsupported Y4M color space" << std::endl;
+                return 1;
+            }
+        }
+
         ck(cuInit(0));
         int nGpu = 0;
         ck(cuDeviceGetCount(&nGpu));
@@ -243,17 +275,45 @@ int main(int argc, char **argv)
         ck(cuDeviceGetName(szDeviceName, sizeof(szDeviceName), cuDevice));
         std::cout << "GPU in use: " << szDeviceName << std::endl;
 
-        uint8_t *pBuf = NULL;
-        uint32_t nBufSize = 0;
-        BufferedFileReader bufferedFileReader(szInFilePath, true);
+        const uint8_t *pBuf = NULL;
+        uint64_t nBufSize = 0;
+        BufferedFileReader bufferedFileReader(szInFilePath);
         if (!bufferedFileReader.GetBuffer(&pBuf, &nBufSize)) {
             std::cout << "Failed to read file " << szInFilePath << std::endl;
             return 1;
         }
+        // Only the frames of a Y4M file are uploaded, back to back
+        if (const Y4mInfo *pY4mInfo = bufferedFileReader.GetY4mInfo())
+        {
+            bufferedFileReader.SetFrameLayout(pY4mInfo->GetFrameSize());
+            nBufSize = bufferedFileReader.GetFrameCount() * pY4mInfo->GetFrameSize();
+            if (!nBufSize)
+            {
+                std::cout << "No complete frame in " << szInFilePath << std::endl;
+                return 1;
+            }
+        }
 
         CUcontext cuContext = NULL;
         ck(cuCtxCreate(&cuContext, CU_CTX_SCHED_BLOCKING_SYNC, cuDevice));
 
+        NvEncPtr pEnc(new NvEncoderCuda(cuContext, nWidth, nHeight, eFormat), EncodeDeleteFunc);
+
+        // Frames are cycled through, so only upload as many whole frames of a large input as fit in
+        // video memory
+        size_t nFreeMem = 0, nTotalMem = 0;
+        ck(cuMemGetInfo(&nFreeMem, &nTotalMem));
+        const uint64_t nFileSize = nBufSize, nFrameSize = pEnc->GetFrameSize();
+        nBufSize = (std::min)(nFileSize, (uint64_t)nFreeMem / 2 / (bSingle ? 1 : nThread)) / nFrameSize * nFrameSize;
+        if (!nBufSize)
+        {
+            std::cout << "Not even one frame of " << szInFilePath << " fits in the buffer" << std::endl;
+            return 1;
+        }
+        if (nBufSize != nFileSize) {
+            LOG(WARNING) << "File is too large - only " << std::setprecision(4) << 100.0 * nBufSize / nFileSize << "% is loaded";
+        }
+
         std::vector<CUdeviceptr> vdpBuf;
 
 
@@ -261,8 +321,7 @@ int main(int argc, char **argv)
         CUdeviceptr dpBuf;
         ck(cuMemAlloc(&dpBuf, nBufSize));
         vdpBuf.push_back(dpBuf);
-        ck(cuMemcpyHtoD(dpBuf, pBuf, nBufSize));
-        NvEncPtr pEnc(new NvEncoderCuda(cuContext, nWidth, nHeight, eFormat), EncodeDeleteFunc);
+        UploadFrames(dpBuf, bufferedFileReader, pBuf, nBufSize);
 
         NV_ENC_INITIALIZE_PARAMS initializeParams = { NV_ENC_INITIALIZE_PARAMS_VER };
         NV_ENC_CONFIG encodeConfig = { NV_ENC_CONFIG_VER };
@@ -282,7 +341,7 @@ int main(int argc, char **argv)
                 CUdeviceptr dpBuf;
                 ck(cuMemAlloc(&dpBuf, nBufSize));
                 vdpBuf.push_back(dpBuf);
-                ck(cuMemcpyHtoD(vdpBuf[i], pBuf, nBufSize));
+                UploadFrames(vdpBuf[i], bufferedFileReader, pBuf, nBufSize);
             }
             NvEncPtr pEncoder(new NvEncoderCuda(cuContext, nWidth, nHeight, eFormat), EncodeDeleteFunc);
             // all the encoder instances share the same config params , so just use the parameters from first encoder instance
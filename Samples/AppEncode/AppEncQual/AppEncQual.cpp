@@ -19,6 +19,7 @@
 #include "../Utils/NvEncoderCLIOptions.h"
 #include "../Utils/NvCodecUtils.h"
 #include "PSNR.h"
+#include "SSIM.h"
 
 simplelogger::Logger *logger = simplelogger::LoggerFactory::CreateConsoleLogger();
 
@@ -32,11 +33,14 @@ void ShowHelpAndExit(const char *szBadOption = NULL)
         oss << "Error parsing \"" << szBadOption << "\"" << std::endl;
     }
     oss << "Options:" << std::endl
-        << "-i           Input file path" << std::endl
+        << "-i           Input file path, raw or Y4M" << std::endl
         << "-o           Output file path" << std::endl
-        << "-s           Input resolution in this form: WxH" << std::endl
+        << "-s           Input resolution in this form: WxH (taken from the header for Y4M)" << std::endl
         << "-if          Input format: iyuv nv12 p010" << std::endl
         << "-gpu         Ordinal of GPU to use" << std::endl
+        << "-ssim        Also report SSIM of each plane and MS-SSIM of luma" << std::endl
+        << "-heatmap     Luma error of each 16x16 (H.264) or 32x32 (HEVC) block, per frame, to this path:" << std::endl
+        << "             a PGM image per frame if it ends with .pgm, raw 32-bit float MSE otherwise" << std::endl
         ;
     oss << NvEncoderInitParam().GetHelpMessage(false, false, true);
     if (bThrowError)
@@ -52,7 +56,7 @@ void ShowHelpAndExit(const char *szBadOption = NULL)
 
 void ParseCommandLine(int argc, char *argv[], char *szInputFileName, int &nWidth, int &nHeight,
     NV_ENC_BUFFER_FORMAT &eFormat, char *szOutputFileName, NvEncoderInitParam &initParam,
-    int &iGpu)
+    int &iGpu, bool &bSsim, char *szHeatmapFileName)
 {
     std::ostringstream oss;
     int i;
@@ -119,6 +123,17 @@ void ParseCommandLine(int argc, char *argv[], char *szInputFileName, int &nWidth
             iGpu = atoi(argv[i]);
             continue;
         }
+        if (!_stricmp(argv[i], "-ssim")) {
+            bSsim = true;
+            continue;
+        }
+        if (!_stricmp(argv[i], "-heatmap")) {
+            if (++i == argc) {
+                ShowHelpAndExit("-heatmap");
+            }
+            sprintf(szHeatmapFileName, "%s", argv[i]);
+            continue;
+        }
         // Regard as encoder parameter
         if (argv[i][0] != '-') {
             ShowHelpAndExit(argv[i]);
@@ -131,8 +146,46 @@ void ParseCommandLine(int argc, char *argv[], char *szInputFileName, int &nWidth
     initParam = NvEncoderInitParam(oss.str().c_str());
 }
 
+/**
+*   @brief  Appends the luma error of each block of a frame to the heatmap file. A PGM image has a
+*   pixel per block that goes from black at 50 dB or more to white at 20 dB or less; raw output is
+*   the MSE of each block as 32-bit floats. Both are in raster order over the block grid.
+*/
+void WriteHeatmap(std::ofstream &fout, bool bPgm, const std::vector<int64_t> &vBlockSse, int nWidth, int nHeight, int nBlockSize, int nMax)
+{
+    const int nBlockX = (nWidth + nBlockSize - 1) / nBlockSize, nBlockY = (nHeight + nBlockSize - 1) / nBlockSize;
+    std::vector<uint8_t> vPixel(bPgm ? vBlockSse.size() : 0);
+    std::vector<float> vMse(bPgm ? 0 : vBlockSse.size());
+    for (int by = 0; by < nBlockY; by++)
+    {
+        for (int bx = 0; bx < nBlockX; bx++)
+        {
+            const int i = by * nBlockX + bx;
+            // Blocks at the right and bottom edges may be smaller
+            const int64_t n = (int64_t)(std::min)(nBlockSize, nWidth - bx * nBlockSize) * (std::min)(nBlockSize, nHeight - by * nBlockSize);
+            if (!bPgm)
+            {
+                vMse[i] = (float)(1.0 * vBlockSse[i] / n);
+                continue;
+            }
+            const double db = vBlockSse[i] ? psnr(vBlockSse[i], n, nMax) : 50.0;
+            vPixel[i] = (uint8_t)((std::min)((std::max)((50.0 - db) * 255 / 30 + 0.5, 0.0), 255.0));
+        }
+    }
+    if (bPgm)
+    {
+        fout << "P5\n" << nBlockX << " " << nBlockY << "\n255\n";
+        fout.write(reinterpret_cast<const char *>(vPixel.data()), vPixel.size());
+    }
+    else
+    {
+        fout.write(reinterpret_cast<const char *>(vMse.data()), vMse.size() * sizeof(float));
+    }
+}
+
 template <typename YuvUnit>
-void EncQual(char *szInFilePath, char *szOutFilePath, int nWidth, int nHeight, NV_ENC_BUFFER_FORMAT eFormat, int iGpu, NvEncoderInitParam &encodeCLIOptions)
+void EncQual(char *szInFilePath, char *szOutFilePath, int nWidth, int nHeight, NV_ENC_BUFFER_FORMAT eFormat, int iGpu, bool bSsim,
+    char *szHeatmapFilePath, NvEncoderInitParam &encodeCLIOptions)
 {
     ck(cuInit(0));
     int nGpu = 0;
@@ -164,26 +217,30 @@ void EncQual(char *szInFilePath, char *szOutFilePath, int nWidth, int nHeight, N
     NvDecoder dec(cuContext, nWidth, nHeight, false, encodeCLIOptions.IsCodecH264() ? cudaVideoCodec_H264 : cudaVideoCodec_HEVC);
 
     int nSize = enc.GetFrameSize();
-    std::streamsize nRead = 0;
-    const int nFrame = 32;
-    std::vector<std::unique_ptr<uint8_t[]>> vEncFrame;
-    for (int i = 0; i < nFrame; i++) 
-    {
-        std::unique_ptr<uint8_t[]> frame(new uint8_t[nSize]);
-        vEncFrame.push_back(std::move(frame));
-    }
-
-    int iEnc = 0, iDec = 0;
-    std::ifstream fpYuv(szInFilePath, std::ifstream::in | std::ifstream::binary);
-    if (!fpYuv)
+    // Input frames are read through views into the mapped file, so decoded frames can be compared
+    // with them however late they come out of the decoder
+    BufferedFileReader yuvReader(szInFilePath);
+    const uint8_t *pYuv = NULL;
+    uint64_t nYuvSize = 0;
+    if (!yuvReader.GetBuffer(&pYuv, &nYuvSize))
     {
         std::cout << "Unable to open input file: " << szInFilePath << std::endl;
         exit(1);
     }
+    yuvReader.SetFrameLayout(nSize);
+    const int nFrameTotal = (int)yuvReader.GetFrameCount();
+    // The decoder outputs NV12 or P016, which the PSNR reads in place when the input is interleaved
+    // too. Planar input and SSIM need planar frames; the input, which is read-only, is then
+    // converted into a scratch frame.
+    const bool bPlanar = eFormat == NV_ENC_BUFFER_FORMAT_IYUV || bSsim;
+    std::unique_ptr<uint8_t[]> pEncPlanarFrame(bPlanar && eFormat != NV_ENC_BUFFER_FORMAT_IYUV ? new uint8_t[nSize] : NULL);
+
+    int iEnc = 0, iDec = 0;
+    bool bEnd = false;
 
     int64_t eySum = 0, euSum = 0, evSum = 0;
     int64_t eyuvMin = INT64_MAX, eyuvMax = INT64_MIN;
-    double sySum = 0, suSum = 0, svSum = 0, syuvSum = 0;
+    double sySum = 0, suSum = 0, svSum = 0, syuvSum = 0, msSsimSum = 0;
     std::cout << std::setprecision(4) << std::fixed;
     YuvConverter<YuvUnit> converter(nWidth, nHeight);
     std::ofstream fout;
@@ -196,6 +253,22 @@ void EncQual(char *szInFilePath, char *szOutFilePath, int nWidth, int nHeight, N
             exit(1);
         }
     }
+    // Blocks of the heatmap follow the grid of H.264 macroblocks or HEVC CTBs, as in AppEncME
+    const int nBlockSize = encodeCLIOptions.IsCodecH264() ? 16 : 32;
+    std::ofstream foutHeatmap;
+    std::vector<int64_t> vBlockSse;
+    const bool bPgm = strlen(szHeatmapFilePath) > 4 && !_stricmp(szHeatmapFilePath + strlen(szHeatmapFilePath) - 4, ".pgm");
+    if (*szHeatmapFilePath)
+    {
+        foutHeatmap.open(szHeatmapFilePath, std::ios::out | std::ios::binary);
+        if (!foutHeatmap.is_open())
+        {
+            std::cout << "Unable to open heatmap file: " << szHeatmapFilePath << std::endl;
+            exit(1);
+        }
+        vBlockSse.resize((size_t)((nWidth + nBlockSize - 1) / nBlockSize) * ((nHeight + nBlockSize - 1) / nBlockSize));
+    }
+    int64_t *pBlockSse = vBlockSse.empty() ? NULL : vBlockSse.data();
     int MAX, shift;
     if (eFormat == NV_ENC_BUFFER_FORMAT_YUV420_10BIT)
     {
@@ -210,13 +283,14 @@ void EncQual(char *szInFilePath, char *szOutFilePath, int nWidth, int nHeight, N
 
     do 
     {
-        nRead = fpYuv.read(reinterpret_cast<char*>(vEncFrame[iEnc % nFrame].get()), nSize).gcount();
+        bEnd = iEnc == nFrameTotal;
         std::vector<std::vector<uint8_t>> vPacket;
-        if (nRead == nSize)
+        if (!bEnd)
         {
             const NvEncInputFrame* encoderInputFrame = enc.GetNextInputFrame();
+            BufferedFileReader::FrameView encFrame = yuvReader.GetFrame(iEnc++);
 
-            NvEncoderCuda::CopyToDeviceFrame(cuContext, vEncFrame[iEnc++ % nFrame].get(), 0, (CUdeviceptr)encoderInputFrame->inputPtr,
+            NvEncoderCuda::CopyToDeviceFrame(cuContext, (uint8_t *)encFrame.pData, encFrame.nPitch, (CUdeviceptr)encoderInputFrame->inputPtr,
                 (int)encoderInputFrame->pitch, enc.GetEncodeWidth(), enc.GetEncodeHeight(), CU_MEMORYTYPE_HOST, 
                 encoderInputFrame->bufferFormat,
                 encoderInputFrame->chromaOffsets,
@@ -236,22 +310,37 @@ void EncQual(char *szInFilePath, char *szOutFilePath, int nWidth, int nHeight, N
 
         uint8_t **apDecFrame;
         int nFrameReturned = 0;
-        dec.Decode(vTmpPacket.data(), (int)vTmpPacket.size(), &apDecFrame, &nFrameReturned, nRead != nSize);
+        dec.Decode(vTmpPacket.data(), (int)vTmpPacket.size(), &apDecFrame, &nFrameReturned, bEnd);
         for (int i = 0; i < nFrameReturned; i++)
         {
-            uint8_t *pEncFrame = vEncFrame[iDec % nFrame].get(), *pDecFrame = apDecFrame[i];
-            if (eFormat != NV_ENC_BUFFER_FORMAT_IYUV)
+            uint8_t *pEncFrame = (uint8_t *)yuvReader.GetFrame(iDec).pData, *pDecFrame = apDecFrame[i];
+            int64_t ey, eu, ev;
+            if (!bPlanar)
+            {
+                SumSquareErrorFor420UVInterleaved((YuvUnit *)pEncFrame, nWidth, (YuvUnit *)pDecFrame, nWidth, nWidth, nHeight, &ey, &eu, &ev, shift,
+                    nBlockSize, pBlockSse);
+            }
+            if (bPlanar || fout.is_open())
             {
-                converter.UVInterleavedToPlanar((YuvUnit *)pEncFrame);
+                converter.UVInterleavedToPlanar((YuvUnit *)pDecFrame);
             }
-            converter.UVInterleavedToPlanar((YuvUnit *)pDecFrame);
             if (fout.is_open())
             {
                 fout.write(reinterpret_cast<char*>(pDecFrame), dec.GetFrameSize());
             }
-
-            int64_t ey, eu, ev;
-            SumSquareErrorFor420Planar((YuvUnit *)pEncFrame, (YuvUnit *)pDecFrame, nWidth, nHeight, &ey, &eu, &ev, shift);
+            if (bPlanar)
+            {
+                if (eFormat != NV_ENC_BUFFER_FORMAT_IYUV)
+                {
+                    converter.UVInterleavedToPlanar((const YuvUnit *)pEncFrame, 0, (YuvUnit *)pEncPlanarFrame.get(), 0);
+                    pEncFrame = pEncPlanarFrame.get();
+                }
+                SumSquareErrorFor420Planar((YuvUnit *)pEncFrame, (YuvUnit *)pDecFrame, nWidth, nHeight, &ey, &eu, &ev, shift, nBlockSize, pBlockSse);
+            }
+            if (foutHeatmap.is_open())
+            {
+                WriteHeatmap(foutHeatmap, bPgm, vBlockSse, nWidth, nHeight, nBlockSize, MAX);
+            }
             eySum += ey; euSum += eu; evSum += ev;
             int64_t eyuv = ey + eu + ev;
             eyuvMin = (std::min)(eyuvMin, eyuv);
@@ -264,14 +353,28 @@ void EncQual(char *szInFilePath, char *szOutFilePath, int nWidth, int nHeight, N
                 << " psnr_avg:" << psnr(eyuv, nWidth * nHeight * 3 / 2, MAX)
                 << " psnr_y:" << psnr(ey, nWidth * nHeight, MAX)
                 << " psnr_u:" << psnr(eu, nWidth * nHeight / 4, MAX)
-                << " psnr_v:" << psnr(ev, nWidth * nHeight / 4, MAX)
-                << " " << std::endl;
+                << " psnr_v:" << psnr(ev, nWidth * nHeight / 4, MAX);
+            if (bSsim)
+            {
+                // Same frames as the PSNR, so that no second pass over the sequence is needed
+                double sy, su, sv, msSsim;
+                SsimFor420Planar((YuvUnit *)pEncFrame, (YuvUnit *)pDecFrame, nWidth, nHeight, shift, MAX, &sy, &su, &sv, &msSsim);
+                double syuv = (4 * sy + su + sv) / 6;
+                sySum += sy; suSum += su; svSum += sv; syuvSum += syuv; msSsimSum += msSsim;
+                std::cout << std::setprecision(4)
+                    << " ssim_avg:" << syuv
+                    << " ssim_y:" << sy
+                    << " ssim_u:" << su
+                    << " ssim_v:" << sv
+                    << " ms_ssim_y:" << msSsim;
+            }
+            std::cout << " " << std::endl;
 
             iDec++;
         }
-    } while (nRead == nSize);
+    } while (!bEnd);
     fout.close();
-    fpYuv.close();
+    foutHeatmap.close();
 
     std::cout << std::setprecision(6);
     std::cout << "PSNR y:" << psnr(eySum, (int64_t)nWidth * nHeight * iEnc, MAX)
@@ -281,7 +384,20 @@ void EncQual(char *szInFilePath, char *szOutFilePath, int nWidth, int nHeight, N
         << " min:" << psnr(eyuvMax, (int64_t)nWidth * nHeight * 3 / 2, MAX)
         << " max:" << psnr(eyuvMin, (int64_t)nWidth * nHeight * 3 / 2, MAX)
         << std::endl;
+    if (bSsim && iDec)
+    {
+        std::cout << "SSIM y:" << sySum / iDec
+            << " u:" << suSum / iDec
+            << " v:" << svSum / iDec
+            << " average:" << syuvSum / iDec
+            << " MS-SSIM y:" << msSsimSum / iDec
+            << std::endl;
+    }
 
+    if (*szHeatmapFilePath) {
+        std::cout << "Heatmap of " << (nWidth + nBlockSize - 1) / nBlockSize << "x" << (nHeight + nBlockSize - 1) / nBlockSize
+            << " blocks of " << nBlockSize << "x" << nBlockSize << " per frame saved in file " << szHeatmapFilePath << std::endl;
+    }
     if (*szOutFilePath) {
         std::cout << "Total frame encoded and decoded: " << iDec << std::endl
             << "Saved in file " << szOutFilePath << " in "
@@ -295,31 +411,48 @@ void EncQual(char *szInFilePath, char *szOutFilePath, int nWidth, int nHeight, N
 
 /**
 *  This sample application demonstrates measurement of encoding quality, in
-*  terms of PSNR. The application encodes frames from the input file and then
-*  decodes them, computing PSNR between input and decoded output. The decoded
-*  output can be saved to a file by using the "-o" option.
+*  terms of PSNR, and optionally SSIM and MS-SSIM ("-ssim"). The application
+*  encodes frames from the input file and then decodes them, computing the
+*  metrics between input and decoded output. The decoded output can be saved
+*  to a file by using the "-o" option, and the luma error of each macroblock or
+*  CTB, which shows where the encode loses quality, by using "-heatmap".
 */
 int main(int argc, char **argv)
 {
     char szInFilePath[256] = "",
-        szOutFilePath[256] = "";
+        szOutFilePath[256] = "",
+        szHeatmapFilePath[256] = "";
     int nWidth = 1920, nHeight = 1080;
     NV_ENC_BUFFER_FORMAT eFormat = NV_ENC_BUFFER_FORMAT_IYUV;
     int iGpu = 0;
+    bool bSsim = false;
     try
     {
         NvEncoderInitParam encodeCLIOptions;
-        ParseCommandLine(argc, argv, szInFilePath, nWidth, nHeight, eFormat, szOutFilePath, encodeCLIOptions, iGpu);
+        ParseCommandLine(argc, argv, szInFilePath, nWidth, nHeight, eFormat, szOutFilePath, encodeCLIOptions, iGpu, bSsim, szHeatmapFilePath);
 
         CheckInputFile(szInFilePath);
 
+        // Y4M input carries its resolution and format, which take precedence over -s and -if
+        Y4mInfo y4mInfo;
+        if (y4mInfo.ParseFile(szInFilePath))
+        {
+            nWidth = y4mInfo.nWidth;
+            nHeight = y4mInfo.nHeight;
+            if (!GetY4mEncodeFormat(y4mInfo, &eFormat) || eFormat != NV_ENC_BUFFER_FORMAT_IYUV)
+            {
+                std::cout << "Unsupported Y4M color space" << std::endl;
+                return 1;
+            }
+        }
+
         if (eFormat == NV_ENC_BUFFER_FORMAT_YUV420_10BIT)
         {
-            EncQual<uint16_t>(szInFilePath, szOutFilePath, nWidth, nHeight, eFormat, iGpu, encodeCLIOptions);
+            EncQual<uint16_t>(szInFilePath, szOutFilePath, nWidth, nHeight, eFormat, iGpu, bSsim, szHeatmapFilePath, encodeCLIOptions);
         }
         else
         {
-            EncQual<uint8_t>(szInFilePath, szOutFilePath, nWidth, nHeight, eFormat, iGpu, encodeCLIOptions);
+            EncQual<uint8_t>(szInFilePath, szOutFilePath, nWidth, nHeight, eFormat, iGpu, bSsim, szHeatmapFilePath, encodeCLIOptions);
         }
     }
     catch (const std::exception &e)
@@ -13,33 +13,337 @@
 
 #include <inttypes.h>
 #include <math.h>
+#include <atomic>
+#include "../../Utils/NvCodecUtils.h"
 
 template <typename T>
-void SumSquareErrorFor420Planar(T *p0, T *p1, int nWidth, int nHeight, int64_t *py, int64_t *pu, int64_t *pv, int shift) {
-    int64_t y = 0, u = 0, v = 0, d;
-    for (int i = 0; i < nWidth * nHeight; i++) {
-        d = (p0[i] >> shift) - (p1[i] >> shift);
-        y += d * d;
+inline int64_t SumSquareErrorRow(const T *p0, const T *p1, int x, int n, int shift) {
+    int64_t e = 0, d;
+    for (; x < n; x++) {
+        d = (p0[x] >> shift) - (p1[x] >> shift);
+        e += d * d;
     }
-    p0 += nWidth * nHeight;
-    p1 += nWidth * nHeight;
-    for (int y = 0; y < nHeight / 2; y++) {
-        for (int x = 0; x < nWidth / 2; x++) {
-            d = (p0[y * nWidth / 2 + x] >> shift) - (p1[y * nWidth / 2 + x] >> shift);
-            u += d * d;
+    return e;
+}
+
+/**
+* @brief SumSquareErrorRow() for interleaved UV; x and n count pairs, and the errors of the first
+* and the second sample of each pair are added to *pu and *pv
+*/
+template <typename T>
+inline void SumSquareErrorRowUV(const T *p0, const T *p1, int x, int n, int shift, int64_t *pu, int64_t *pv) {
+    int64_t eu = 0, ev = 0, d;
+    for (; x < n; x++) {
+        d = (p0[2 * x] >> shift) - (p1[2 * x] >> shift);
+        eu += d * d;
+        d = (p0[2 * x + 1] >> shift) - (p1[2 * x + 1] >> shift);
+        ev += d * d;
+    }
+    *pu += eu;
+    *pv += ev;
+}
+
+/**
+* @brief Squared error of columns [x, nWidth) of a block of nWidth x nHeight samples
+*/
+template <typename T>
+inline int64_t SumSquareErrorBlock(const T *p0, int nPitch0, const T *p1, int nPitch1, int x, int nWidth, int nHeight, int shift) {
+    int64_t e = 0;
+    for (int y = 0; y < nHeight; y++) {
+        e += SumSquareErrorRow(p0 + (size_t)y * nPitch0, p1 + (size_t)y * nPitch1, x, nWidth, shift);
+    }
+    return e;
+}
+
+#ifdef HOST_AVX2
+HOST_AVX2_TARGET inline int64_t SumInt64Avx2(__m256i v) {
+    alignas(32) int64_t a[4];
+    _mm256_store_si256((__m256i *)a, v);
+    return a[0] + a[1] + a[2] + a[3];
+}
+
+/**
+* @brief Adds the squared errors of samples [0, x) to *pSum and returns x; the rest is left to
+* SumSquareErrorRow()
+*/
+HOST_AVX2_TARGET inline int SumSquareErrorRowAvx2(const uint8_t *p0, const uint8_t *p1, int n, int shift, int64_t *pSum) {
+    const __m128i s = _mm_cvtsi32_si128(shift);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i sum = zero;
+    int x = 0;
+    while (x + 32 <= n) {
+        // Each 32-bit lane gains at most 4 * 255^2 per vector; widen before it can overflow
+        __m256i sum32 = zero;
+        for (int i = 0; i < 2048 && x + 32 <= n; i++, x += 32) {
+            __m256i a = _mm256_loadu_si256((const __m256i *)(p0 + x)), b = _mm256_loadu_si256((const __m256i *)(p1 + x));
+            __m256i d0 = _mm256_sub_epi16(_mm256_srl_epi16(_mm256_unpacklo_epi8(a, zero), s), _mm256_srl_epi16(_mm256_unpacklo_epi8(b, zero), s)),
+                d1 = _mm256_sub_epi16(_mm256_srl_epi16(_mm256_unpackhi_epi8(a, zero), s), _mm256_srl_epi16(_mm256_unpackhi_epi8(b, zero), s));
+            sum32 = _mm256_add_epi32(sum32, _mm256_add_epi32(_mm256_madd_epi16(d0, d0), _mm256_madd_epi16(d1, d1)));
+        }
+        sum = _mm256_add_epi64(sum, _mm256_add_epi64(_mm256_unpacklo_epi32(sum32, zero), _mm256_unpackhi_epi32(sum32, zero)));
+    }
+    *pSum += SumInt64Avx2(sum);
+    return x;
+}
+
+/**
+* @brief Squared errors of 16 samples, summed into 64-bit lanes such that even lanes hold only even
+* samples and odd lanes only odd samples
+*/
+HOST_AVX2_TARGET inline __m256i SquareErrorUInt16Avx2(const uint16_t *p0, const uint16_t *p1, __m128i s) {
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i a = _mm256_srl_epi16(_mm256_loadu_si256((const __m256i *)p0), s),
+        b = _mm256_srl_epi16(_mm256_loadu_si256((const __m256i *)p1), s);
+    // |a - b| needs all 16 bits without a shift, and its square needs 32
+    __m256i d = _mm256_or_si256(_mm256_subs_epu16(a, b), _mm256_subs_epu16(b, a));
+    __m256i lo = _mm256_mullo_epi16(d, d), hi = _mm256_mulhi_epu16(d, d);
+    __m256i e0 = _mm256_unpacklo_epi16(lo, hi), e1 = _mm256_unpackhi_epi16(lo, hi);
+    return _mm256_add_epi64(_mm256_add_epi64(_mm256_unpacklo_epi32(e0, zero), _mm256_unpackhi_epi32(e0, zero)),
+        _mm256_add_epi64(_mm256_unpacklo_epi32(e1, zero), _mm256_unpackhi_epi32(e1, zero)));
+}
+
+HOST_AVX2_TARGET inline int SumSquareErrorRowAvx2(const uint16_t *p0, const uint16_t *p1, int n, int shift, int64_t *pSum) {
+    const __m128i s = _mm_cvtsi32_si128(shift);
+    __m256i sum = _mm256_setzero_si256();
+    int x = 0;
+    for (; x + 16 <= n; x += 16) {
+        sum = _mm256_add_epi64(sum, SquareErrorUInt16Avx2(p0 + x, p1 + x, s));
+    }
+    *pSum += SumInt64Avx2(sum);
+    return x;
+}
+
+/**
+* @brief Adds the squared errors of columns [0, x) of a block of up to 128x128 samples to *pSum and
+* returns x; the rest is left to SumSquareErrorBlock(). The sums stay in registers for the whole
+* block, so a block costs about as much as its rows do in SumSquareErrorRowAvx2().
+*/
+HOST_AVX2_TARGET inline int SumSquareErrorBlockAvx2(const uint8_t *p0, int nPitch0, const uint8_t *p1, int nPitch1, int nWidth, int nHeight, int shift, int64_t *pSum) {
+    const __m128i s = _mm_cvtsi32_si128(shift);
+    const __m256i zero = _mm256_setzero_si256();
+    // Each 32-bit lane gains at most 2 * 255^2 per 16 samples, so 128x128 samples can't overflow it
+    __m256i sum32 = zero;
+    const int n = nWidth / 16 * 16;
+    for (int y = 0; y < nHeight; y++) {
+        const uint8_t *pRow0 = p0 + (size_t)y * nPitch0, *pRow1 = p1 + (size_t)y * nPitch1;
+        int x = 0;
+        for (; x + 32 <= n; x += 32) {
+            __m256i a = _mm256_loadu_si256((const __m256i *)(pRow0 + x)), b = _mm256_loadu_si256((const __m256i *)(pRow1 + x));
+            __m256i d0 = _mm256_sub_epi16(_mm256_srl_epi16(_mm256_unpacklo_epi8(a, zero), s), _mm256_srl_epi16(_mm256_unpacklo_epi8(b, zero), s)),
+                d1 = _mm256_sub_epi16(_mm256_srl_epi16(_mm256_unpackhi_epi8(a, zero), s), _mm256_srl_epi16(_mm256_unpackhi_epi8(b, zero), s));
+            sum32 = _mm256_add_epi32(sum32, _mm256_add_epi32(_mm256_madd_epi16(d0, d0), _mm256_madd_epi16(d1, d1)));
+        }
+        for (; x < n; x += 16) {
+            __m256i d = _mm256_sub_epi16(_mm256_srl_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(pRow0 + x))), s),
+                _mm256_srl_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(pRow1 + x))), s));
+            sum32 = _mm256_add_epi32(sum32, _mm256_madd_epi16(d, d));
+        }
+    }
+    *pSum += SumInt64Avx2(_mm256_add_epi64(_mm256_unpacklo_epi32(sum32, zero), _mm256_unpackhi_epi32(sum32, zero)));
+    return n;
+}
+
+HOST_AVX2_TARGET inline int SumSquareErrorBlockAvx2(const uint16_t *p0, int nPitch0, const uint16_t *p1, int nPitch1, int nWidth, int nHeight, int shift, int64_t *pSum) {
+    const __m128i s = _mm_cvtsi32_si128(shift);
+    __m256i sum = _mm256_setzero_si256();
+    const int n = nWidth / 16 * 16;
+    for (int y = 0; y < nHeight; y++) {
+        const uint16_t *pRow0 = p0 + (size_t)y * nPitch0, *pRow1 = p1 + (size_t)y * nPitch1;
+        for (int x = 0; x < n; x += 16) {
+            sum = _mm256_add_epi64(sum, SquareErrorUInt16Avx2(pRow0 + x, pRow1 + x, s));
+        }
+    }
+    *pSum += SumInt64Avx2(sum);
+    return n;
+}
+
+/**
+* @brief Adds the squared errors of pairs [0, x) to *pu and *pv and returns x; the rest is left to
+* SumSquareErrorRowUV()
+*/
+HOST_AVX2_TARGET inline int SumSquareErrorRowUVAvx2(const uint8_t *p0, const uint8_t *p1, int n, int shift, int64_t *pu, int64_t *pv) {
+    const __m128i s = _mm_cvtsi32_si128(shift);
+    const __m256i zero = _mm256_setzero_si256(), uMask = _mm256_set1_epi32(0xFFFF);
+    __m256i sumU = zero, sumV = zero;
+    int x = 0;
+    while (x + 16 <= n) {
+        // As in SumSquareErrorRowAvx2(), but madd() of the masked differences keeps U and V apart
+        __m256i sumU32 = zero, sumV32 = zero;
+        for (int i = 0; i < 2048 && x + 16 <= n; i++, x += 16) {
+            __m256i a = _mm256_loadu_si256((const __m256i *)(p0 + 2 * x)), b = _mm256_loadu_si256((const __m256i *)(p1 + 2 * x));
+            __m256i d0 = _mm256_sub_epi16(_mm256_srl_epi16(_mm256_unpacklo_epi8(a, zero), s), _mm256_srl_epi16(_mm256_unpacklo_epi8(b, zero), s)),
+                d1 = _mm256_sub_epi16(_mm256_srl_epi16(_mm256_unpackhi_epi8(a, zero), s), _mm256_srl_epi16(_mm256_unpackhi_epi8(b, zero), s));
+            __m256i u0 = _mm256_and_si256(d0, uMask), v0 = _mm256_andnot_si256(uMask, d0),
+                u1 = _mm256_and_si256(d1, uMask), v1 = _mm256_andnot_si256(uMask, d1);
+            sumU32 = _mm256_add_epi32(sumU32, _mm256_add_epi32(_mm256_madd_epi16(u0, u0), _mm256_madd_epi16(u1, u1)));
+            sumV32 = _mm256_add_epi32(sumV32, _mm256_add_epi32(_mm256_madd_epi16(v0, v0), _mm256_madd_epi16(v1, v1)));
         }
+        sumU = _mm256_add_epi64(sumU, _mm256_add_epi64(_mm256_unpacklo_epi32(sumU32, zero), _mm256_unpackhi_epi32(sumU32, zero)));
+        sumV = _mm256_add_epi64(sumV, _mm256_add_epi64(_mm256_unpacklo_epi32(sumV32, zero), _mm256_unpackhi_epi32(sumV32, zero)));
+    }
+    *pu += SumInt64Avx2(sumU);
+    *pv += SumInt64Avx2(sumV);
+    return x;
+}
+
+HOST_AVX2_TARGET inline int SumSquareErrorRowUVAvx2(const uint16_t *p0, const uint16_t *p1, int n, int shift, int64_t *pu, int64_t *pv) {
+    const __m128i s = _mm_cvtsi32_si128(shift);
+    __m256i sum = _mm256_setzero_si256();
+    int x = 0;
+    for (; x + 8 <= n; x += 8) {
+        sum = _mm256_add_epi64(sum, SquareErrorUInt16Avx2(p0 + 2 * x, p1 + 2 * x, s));
+    }
+    alignas(32) int64_t a[4];
+    _mm256_store_si256((__m256i *)a, sum);
+    *pu += a[0] + a[2];
+    *pv += a[1] + a[3];
+    return x;
+}
+#endif
+
+/**
+* @brief A plane of the two frames being compared. Offsets and pitches are in samples. nWidth of an
+* interleaved UV plane counts pairs, whose errors go to sums iSum and iSum + 1.
+*/
+struct SumSquareErrorPlane {
+    size_t nOffset0, nOffset1;
+    int nPitch0, nPitch1;
+    int nWidth, nHeight;
+    bool bUVInterleaved;
+    int iSum;
+};
+
+/**
+* @brief Sums of squared errors of the three components of two frames, after shifting the samples
+* right by shift. The rows of all planes are split into bands over ParallelFor().
+* With pBlockSse, aPlane[0], which must not be interleaved, is measured in blocks of nBlockSize
+* (up to 128) squared instead of in rows, and the error of each block is stored there in raster
+* order; blocks at the right and bottom edges may be smaller. This is the same pass that makes the
+* plane's sum.
+*/
+template <typename T>
+void SumSquareErrorForPlanes(const T *p0, const T *p1, const SumSquareErrorPlane *aPlane, int nPlane, int64_t *py, int64_t *pu, int64_t *pv, int shift,
+    int nBlockSize = 0, int64_t *pBlockSse = NULL) {
+    int nRow = 0;
+    for (int i = 0; i < nPlane; i++) {
+        nRow += aPlane[i].nHeight;
     }
-    p0 += nWidth * nHeight / 4;
-    p1 += nWidth * nHeight / 4;
-    for (int y = 0; y < nHeight / 2; y++) {
-        for (int x = 0; x < nWidth / 2; x++) {
-            d = (p0[y * nWidth / 2 + x] >> shift) - (p1[y * nWidth / 2 + x] >> shift);
-            v += d * d;
+    std::atomic<int64_t> aSum[3];
+    for (std::atomic<int64_t> &sum : aSum) {
+        sum = 0;
+    }
+    ParallelFor(nRow, [&](int iBegin, int iEnd) {
+        int64_t aBandSum[3] = {};
+        // Plane of row r and the index of its first row
+        int iPlane = 0, iPlaneRow = 0;
+        for (int r = iBegin; r < iEnd; r++) {
+            if (pBlockSse && r < aPlane[0].nHeight) {
+                // Bands are aligned to nBlockSize, so r starts a block row that this band owns
+                const SumSquareErrorPlane &plane = aPlane[0];
+                const int nBlockHeight = (std::min)(nBlockSize, plane.nHeight - r), nBlockX = (plane.nWidth + nBlockSize - 1) / nBlockSize;
+                for (int bx = 0; bx < nBlockX; bx++) {
+                    const T *pBlock0 = p0 + plane.nOffset0 + (size_t)r * plane.nPitch0 + bx * nBlockSize,
+                        *pBlock1 = p1 + plane.nOffset1 + (size_t)r * plane.nPitch1 + bx * nBlockSize;
+                    const int nBlockWidth = (std::min)(nBlockSize, plane.nWidth - bx * nBlockSize);
+                    int64_t e = 0;
+                    int x = 0;
+#ifdef HOST_AVX2
+                    if (IsAvx2Supported()) {
+                        x = SumSquareErrorBlockAvx2(pBlock0, plane.nPitch0, pBlock1, plane.nPitch1, nBlockWidth, nBlockHeight, shift, &e);
+                    }
+#endif
+                    e += SumSquareErrorBlock(pBlock0, plane.nPitch0, pBlock1, plane.nPitch1, x, nBlockWidth, nBlockHeight, shift);
+                    pBlockSse[r / nBlockSize * nBlockX + bx] = e;
+                    aBandSum[plane.iSum] += e;
+                }
+                r += nBlockHeight - 1;
+                continue;
+            }
+            while (r - iPlaneRow >= aPlane[iPlane].nHeight) {
+                iPlaneRow += aPlane[iPlane++].nHeight;
+            }
+            const SumSquareErrorPlane &plane = aPlane[iPlane];
+            const T *pRow0 = p0 + plane.nOffset0 + (size_t)(r - iPlaneRow) * plane.nPitch0,
+                *pRow1 = p1 + plane.nOffset1 + (size_t)(r - iPlaneRow) * plane.nPitch1;
+            int64_t *pSum = &aBandSum[plane.iSum];
+            int x = 0;
+            if (plane.bUVInterleaved) {
+#ifdef HOST_AVX2
+                if (IsAvx2Supported()) {
+                    x = SumSquareErrorRowUVAvx2(pRow0, pRow1, plane.nWidth, shift, pSum, pSum + 1);
+                }
+#endif
+                SumSquareErrorRowUV(pRow0, pRow1, x, plane.nWidth, shift, pSum, pSum + 1);
+            } else {
+#ifdef HOST_AVX2
+                if (IsAvx2Supported()) {
+                    x = SumSquareErrorRowAvx2(pRow0, pRow1, plane.nWidth, shift, pSum);
+                }
+#endif
+                *pSum += SumSquareErrorRow(pRow0, pRow1, x, plane.nWidth, shift);
+            }
+        }
+        for (int i = 0; i < 3; i++) {
+            aSum[i] += aBandSum[i];
         }
+    }, 16, pBlockSse ? nBlockSize : 1);
+    *py = aSum[0];
+    *pu = aSum[1];
+    *pv = aSum[2];
+}
+
+/**
+* @brief 4:2:0 planar frames laid out like YuvConverter's, with chroma pitches half the luma pitch.
+* Like the other frame functions, it can also measure the luma in blocks; see
+* SumSquareErrorForPlanes().
+*/
+template <typename T>
+void SumSquareErrorFor420Planar(const T *p0, int nPitch0, const T *p1, int nPitch1, int nWidth, int nHeight, int64_t *py, int64_t *pu, int64_t *pv, int shift,
+    int nBlockSize = 0, int64_t *pLumaBlockSse = NULL) {
+    const int nChromaWidth = nWidth / 2, nChromaHeight = nHeight / 2;
+    const SumSquareErrorPlane aPlane[] = {
+        {0, 0, nPitch0, nPitch1, nWidth, nHeight, false, 0},
+        {(size_t)nPitch0 * nHeight, (size_t)nPitch1 * nHeight, nPitch0 / 2, nPitch1 / 2, nChromaWidth, nChromaHeight, false, 1},
+        {(size_t)nPitch0 * nHeight + (size_t)(nPitch0 / 2) * nChromaHeight, (size_t)nPitch1 * nHeight + (size_t)(nPitch1 / 2) * nChromaHeight,
+            nPitch0 / 2, nPitch1 / 2, nChromaWidth, nChromaHeight, false, 2},
+    };
+    SumSquareErrorForPlanes(p0, p1, aPlane, 3, py, pu, pv, shift, nBlockSize, pLumaBlockSse);
+}
+
+/**
+* @brief Packed 4:2:0 planar frames
+*/
+template <typename T>
+void SumSquareErrorFor420Planar(const T *p0, const T *p1, int nWidth, int nHeight, int64_t *py, int64_t *pu, int64_t *pv, int shift,
+    int nBlockSize = 0, int64_t *pLumaBlockSse = NULL) {
+    SumSquareErrorFor420Planar(p0, nWidth, p1, nWidth, nWidth, nHeight, py, pu, pv, shift, nBlockSize, pLumaBlockSse);
+}
+
+/**
+* @brief NV12, or P016 and P010, read in place: the UV plane follows the luma rows at the same pitch
+*/
+template <typename T>
+void SumSquareErrorFor420UVInterleaved(const T *p0, int nPitch0, const T *p1, int nPitch1, int nWidth, int nHeight, int64_t *py, int64_t *pu, int64_t *pv, int shift,
+    int nBlockSize = 0, int64_t *pLumaBlockSse = NULL) {
+    const SumSquareErrorPlane aPlane[] = {
+        {0, 0, nPitch0, nPitch1, nWidth, nHeight, false, 0},
+        {(size_t)nPitch0 * nHeight, (size_t)nPitch1 * nHeight, nPitch0, nPitch1, nWidth / 2, nHeight / 2, true, 1},
+    };
+    SumSquareErrorForPlanes(p0, p1, aPlane, 2, py, pu, pv, shift, nBlockSize, pLumaBlockSse);
+}
+
+/**
+* @brief 4:4:4 planar frames, such as YUV444 and YUV444_10BIT encoder input, with three full planes
+* at the same pitch
+*/
+template <typename T>
+void SumSquareErrorFor444Planar(const T *p0, int nPitch0, const T *p1, int nPitch1, int nWidth, int nHeight, int64_t *py, int64_t *pu, int64_t *pv, int shift,
+    int nBlockSize = 0, int64_t *pLumaBlockSse = NULL) {
+    SumSquareErrorPlane aPlane[3];
+    for (int i = 0; i < 3; i++) {
+        aPlane[i] = {(size_t)nPitch0 * nHeight * i, (size_t)nPitch1 * nHeight * i, nPitch0, nPitch1, nWidth, nHeight, false, i};
     }
-    *py = y;
-    *pu = u;
-    *pv = v;
+    SumSquareErrorForPlanes(p0, p1, aPlane, 3, py, pu, pv, shift, nBlockSize, pLumaBlockSse);
 }
 
 inline double psnr(int64_t sse, int64_t n, double max) {
@@ -0,0 +1,310 @@
+/*
+* Copyright 2017-2018 NVIDIA Corporation.  All rights reserved.
+*
+* Please refer to the NVIDIA end user license agreement (EULA) associated
+* with this source code for terms and conditions that govern your use of
+* this software. Any use, reproduction, disclosure, or distribution of
+* this software and related documentation outside the terms of the EULA
+* is strictly prohibited.
+*
+*/
+
+#pragma once
+
+#include <inttypes.h>
+#include <math.h>
+#include <vector>
+#include "../../Utils/NvCodecUtils.h"
+
+/**
+* @brief SSIM over 8x8 windows placed every 4 samples, with the constants of the original paper
+* (K1 = 0.01, K2 = 0.03). Each window is built from the sums of four 4x4 blocks, which are computed
+* once per block. Samples are shifted right by shift first, and nMax is the peak value after the
+* shift.
+*/
+struct SsimBlockSum {
+    int64_t s0, s1, ss, s01;
+};
+
+template <typename T>
+inline void SsimBlockSumRow(const T *p0, const T *p1, int nPitch, int shift, int iBlock, int nBlock, SsimBlockSum *pSum) {
+    for (; iBlock < nBlock; iBlock++) {
+        SsimBlockSum sum = {};
+        for (int y = 0; y < 4; y++) {
+            for (int x = iBlock * 4; x < iBlock * 4 + 4; x++) {
+                int64_t a = p0[(size_t)y * nPitch + x] >> shift, b = p1[(size_t)y * nPitch + x] >> shift;
+                sum.s0 += a;
+                sum.s1 += b;
+                sum.ss += a * a + b * b;
+                sum.s01 += a * b;
+            }
+        }
+        pSum[iBlock] = sum;
+    }
+}
+
+#ifdef HOST_AVX2
+/**
+* @brief Loads sixteen 8- or 16-bit units as 16-bit values
+*/
+template <typename T>
+HOST_AVX2_TARGET inline __m256i LoadUnitsAsInt16Avx2(const T *p) {
+    return sizeof(T) == 1 ? _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)p)) : _mm256_loadu_si256((const __m256i *)p);
+}
+
+/**
+* @brief Block sums for blocks [0, i), four blocks per iteration; returns i. Samples must be below
+* 4096 after the shift, so that the sums of a block fit in 32 bits.
+*/
+template <typename T>
+HOST_AVX2_TARGET inline int SsimBlockSumRowAvx2(const T *p0, const T *p1, int nPitch, int shift, int nBlock, SsimBlockSum *pSum) {
+    const __m128i s = _mm_cvtsi32_si128(shift);
+    const __m256i one = _mm256_set1_epi16(1);
+    int i = 0;
+    for (; i + 4 <= nBlock; i += 4) {
+        // Pairs of neighbouring samples are summed by madd, two pairs per block and row
+        __m256i s0 = _mm256_setzero_si256(), s1 = s0, ss = s0, s01 = s0;
+        for (int y = 0; y < 4; y++) {
+            __m256i a = _mm256_srl_epi16(LoadUnitsAsInt16Avx2(p0 + (size_t)y * nPitch + i * 4), s),
+                b = _mm256_srl_epi16(LoadUnitsAsInt16Avx2(p1 + (size_t)y * nPitch + i * 4), s);
+            s0 = _mm256_add_epi32(s0, _mm256_madd_epi16(a, one));
+            s1 = _mm256_add_epi32(s1, _mm256_madd_epi16(b, one));
+            ss = _mm256_add_epi32(ss, _mm256_add_epi32(_mm256_madd_epi16(a, a), _mm256_madd_epi16(b, b)));
+            s01 = _mm256_add_epi32(s01, _mm256_madd_epi16(a, b));
+        }
+        // Per 128-bit lane, which holds two blocks: s0 and s1, then ss and s01, of both blocks
+        __m256i x = _mm256_shuffle_epi32(_mm256_hadd_epi32(s0, s1), _MM_SHUFFLE(3, 1, 2, 0)),
+            y = _mm256_shuffle_epi32(_mm256_hadd_epi32(ss, s01), _MM_SHUFFLE(3, 1, 2, 0));
+        // The layout of SsimBlockSum; the low lanes hold blocks i and i + 1
+        __m256i even = _mm256_unpacklo_epi64(x, y), odd = _mm256_unpackhi_epi64(x, y);
+        _mm256_storeu_si256((__m256i *)&pSum[i], _mm256_cvtepi32_epi64(_mm256_castsi256_si128(even)));
+        _mm256_storeu_si256((__m256i *)&pSum[i + 1], _mm256_cvtepi32_epi64(_mm256_castsi256_si128(odd)));
+        _mm256_storeu_si256((__m256i *)&pSum[i + 2], _mm256_cvtepi32_epi64(_mm256_extracti128_si256(even, 1)));
+        _mm256_storeu_si256((__m256i *)&pSum[i + 3], _mm256_cvtepi32_epi64(_mm256_extracti128_si256(odd, 1)));
+    }
+    return i;
+}
+#endif
+
+/**
+* @brief Adds up SSIM and the contrast-structure term of windows [x, n) of a window row. apSum holds
+* s0, s1, ss and s01 of each block column, summed over the two block rows of the window row; c1 and
+* c2 are scaled by 64^2 like the sums.
+*/
+inline void SsimWindowRow(const double *const apSum[4], int x, int n, double c1, double c2, double *pSsim, double *pCs) {
+    for (; x < n; x++) {
+        double s0 = apSum[0][x] + apSum[0][x + 1], s1 = apSum[1][x] + apSum[1][x + 1],
+            ss = apSum[2][x] + apSum[2][x + 1], s01 = apSum[3][x] + apSum[3][x + 1];
+        double s0s1 = s0 * s1, sq = s0 * s0 + s1 * s1;
+        double cs = (2.0 * (64.0 * s01 - s0s1) + c2) / (64.0 * ss - sq + c2);
+        *pSsim += (2.0 * s0s1 + c1) / (sq + c1) * cs;
+        *pCs += cs;
+    }
+}
+
+#ifdef HOST_AVX2
+HOST_AVX2_TARGET inline int SsimWindowRowAvx2(const double *const apSum[4], int n, double c1, double c2, double *pSsim, double *pCs) {
+    const __m256d vc1 = _mm256_set1_pd(c1), vc2 = _mm256_set1_pd(c2), two = _mm256_set1_pd(2.0), n64 = _mm256_set1_pd(64.0);
+    __m256d ssim = _mm256_setzero_pd(), csSum = ssim;
+    int x = 0;
+    for (; x + 4 <= n; x += 4) {
+        __m256d s[4];
+        for (int k = 0; k < 4; k++) {
+            s[k] = _mm256_add_pd(_mm256_loadu_pd(apSum[k] + x), _mm256_loadu_pd(apSum[k] + x + 1));
+        }
+        __m256d s0s1 = _mm256_mul_pd(s[0], s[1]), sq = _mm256_add_pd(_mm256_mul_pd(s[0], s[0]), _mm256_mul_pd(s[1], s[1]));
+        __m256d cs = _mm256_div_pd(_mm256_add_pd(_mm256_mul_pd(two, _mm256_sub_pd(_mm256_mul_pd(n64, s[3]), s0s1)), vc2),
+            _mm256_add_pd(_mm256_sub_pd(_mm256_mul_pd(n64, s[2]), sq), vc2));
+        __m256d l = _mm256_div_pd(_mm256_add_pd(_mm256_mul_pd(two, s0s1), vc1), _mm256_add_pd(sq, vc1));
+        ssim = _mm256_add_pd(ssim, _mm256_mul_pd(l, cs));
+        csSum = _mm256_add_pd(csSum, cs);
+    }
+    alignas(32) double a[2][4];
+    _mm256_store_pd(a[0], ssim);
+    _mm256_store_pd(a[1], csSum);
+    *pSsim += a[0][0] + a[0][1] + a[0][2] + a[0][3];
+    *pCs += a[1][0] + a[1][1] + a[1][2] + a[1][3];
+    return x;
+}
+#endif
+
+/**
+* @brief Mean SSIM of a plane; the mean contrast-structure term, which MS-SSIM uses for all but the
+* coarsest scale, goes to *pCs. Planes smaller than one window count as identical.
+*/
+template <typename T>
+double SsimPlane(const T *p0, const T *p1, int nWidth, int nHeight, int nPitch, int shift, int nMax, double *pCs = NULL) {
+    const int nBlockWidth = nWidth / 4, nBlockHeight = nHeight / 4;
+    if (nBlockWidth < 2 || nBlockHeight < 2) {
+        if (pCs) {
+            *pCs = 1.0;
+        }
+        return 1.0;
+    }
+    // The constants are scaled by 64^2, like the sums of a window
+    const double c1 = 0.01 * 0.01 * nMax * nMax * 64 * 64, c2 = 0.03 * 0.03 * nMax * nMax * 64 * 64;
+    // Each band leaves its sums at its first row; adding them up in row order keeps the result
+    // independent of the order the bands finish in
+    std::vector<double> vSsim(nBlockHeight - 1), vCs(nBlockHeight - 1);
+    ParallelFor(nBlockHeight - 1, [&](int iBegin, int iEnd) {
+        std::vector<SsimBlockSum> vSum(2 * (size_t)nBlockWidth);
+        std::vector<double> vWindowSum(4 * (size_t)nBlockWidth);
+        const double *const apWindowSum[4] = {&vWindowSum[0], &vWindowSum[nBlockWidth], &vWindowSum[2 * nBlockWidth], &vWindowSum[3 * nBlockWidth]};
+        double ssim = 0, cs = 0;
+        for (int y = iBegin; y <= iEnd; y++) {
+            const T *pRow0 = p0 + (size_t)y * 4 * nPitch, *pRow1 = p1 + (size_t)y * 4 * nPitch;
+            SsimBlockSum *pSum = vSum.data() + (y & 1) * nBlockWidth, *pPrevSum = vSum.data() + (~y & 1) * nBlockWidth;
+            int i = 0;
+#ifdef HOST_AVX2
+            if (nMax < 4096 && IsAvx2Supported()) {
+                i = SsimBlockSumRowAvx2(pRow0, pRow1, nPitch, shift, nBlockWidth, pSum);
+            }
+#endif
+            SsimBlockSumRow(pRow0, pRow1, nPitch, shift, i, nBlockWidth, pSum);
+            if (y == iBegin) {
+                continue;
+            }
+            // Sums stay exact as doubles; adding neighbouring columns completes the windows
+            for (int x = 0; x < nBlockWidth; x++) {
+                vWindowSum[x] = (double)(pPrevSum[x].s0 + pSum[x].s0);
+                vWindowSum[nBlockWidth + x] = (double)(pPrevSum[x].s1 + pSum[x].s1);
+                vWindowSum[2 * nBlockWidth + x] = (double)(pPrevSum[x].ss + pSum[x].ss);
+                vWindowSum[3 * nBlockWidth + x] = (double)(pPrevSum[x].s01 + pSum[x].s01);
+            }
+            int x = 0;
+#ifdef HOST_AVX2
+            if (IsAvx2Supported()) {
+                x = SsimWindowRowAvx2(apWindowSum, nBlockWidth - 1, c1, c2, &ssim, &cs);
+            }
+#endif
+            SsimWindowRow(apWindowSum, x, nBlockWidth - 1, c1, c2, &ssim, &cs);
+        }
+        vSsim[iBegin] = ssim;
+        vCs[iBegin] = cs;
+    }, 4);
+    double ssimSum = 0, csSum = 0;
+    for (int y = 0; y < nBlockHeight - 1; y++) {
+        ssimSum += vSsim[y];
+        csSum += vCs[y];
+    }
+    const double nWindow = (double)(nBlockWidth - 1) * (nBlockHeight - 1);
+    if (pCs) {
+        *pCs = csSum / nWindow;
+    }
+    return ssimSum / nWindow;
+}
+
+/**
+* @brief Averages 2x2 blocks of samples [2 * x, 2 * n) of two rows into samples [x, n)
+*/
+template <typename T>
+inline void HalveRow(const T *pRow0, const T *pRow1, int shift, int x, int n, uint16_t *pDst) {
+    for (; x < n; x++) {
+        pDst[x] = (uint16_t)(((pRow0[2 * x] >> shift) + (pRow0[2 * x + 1] >> shift)
+            + (pRow1[2 * x] >> shift) + (pRow1[2 * x + 1] >> shift) + 2) >> 2);
+    }
+}
+
+#ifdef HOST_AVX2
+template <typename T>
+HOST_AVX2_TARGET inline int HalveRowAvx2(const T *pRow0, const T *pRow1, int shift, int n, uint16_t *pDst) {
+    const __m128i s = _mm_cvtsi32_si128(shift);
+    const __m256i round = _mm256_set1_epi32(2);
+    int x = 0;
+    for (; x + 8 <= n; x += 8) {
+        __m256i lo = _mm256_add_epi32(_mm256_srl_epi32(LoadUnitsAsInt32Avx2(pRow0 + 2 * x), s), _mm256_srl_epi32(LoadUnitsAsInt32Avx2(pRow1 + 2 * x), s)),
+            hi = _mm256_add_epi32(_mm256_srl_epi32(LoadUnitsAsInt32Avx2(pRow0 + 2 * x + 8), s), _mm256_srl_epi32(LoadUnitsAsInt32Avx2(pRow1 + 2 * x + 8), s));
+        // hadd works within 128-bit lanes; the permute puts the eight sums back in order
+        __m256i v = _mm256_permute4x64_epi64(_mm256_hadd_epi32(lo, hi), _MM_SHUFFLE(3, 1, 2, 0));
+        StoreInt32AsUnitsAvx2(pDst + x, _mm256_srli_epi32(_mm256_add_epi32(v, round), 2));
+    }
+    return x;
+}
+#endif
+
+/**
+* @brief Halves a plane by averaging 2x2 blocks, for the scales of MS-SSIM
+*/
+template <typename T>
+void HalvePlane(const T *pSrc, int nSrcPitch, int shift, int nDstWidth, int nDstHeight, uint16_t *pDst) {
+    ParallelFor(nDstHeight, [&](int iBegin, int iEnd) {
+        for (int y = iBegin; y < iEnd; y++) {
+            const T *pRow0 = pSrc + (size_t)y * 2 * nSrcPitch, *pRow1 = pRow0 + nSrcPitch;
+            uint16_t *pDstRow = pDst + (size_t)y * nDstWidth;
+            int x = 0;
+#ifdef HOST_AVX2
+            if (IsAvx2Supported()) {
+                x = HalveRowAvx2(pRow0, pRow1, shift, nDstWidth, pDstRow);
+            }
+#endif
+            HalveRow(pRow0, pRow1, shift, x, nDstWidth, pDstRow);
+        }
+    }, 16, GetRowBandAlignment(nDstWidth * (int)sizeof(uint16_t)));
+}
+
+/**
+* @brief MS-SSIM over five scales with the weights of Wang et al.; the contrast-structure terms are
+* clamped at 0. Scales that get smaller than one window count as identical. The SSIM of the full
+* scale comes along for free and goes to *pSsim.
+*/
+template <typename T>
+double MsSsimPlane(const T *p0, const T *p1, int nWidth, int nHeight, int nPitch, int shift, int nMax, double *pSsim = NULL) {
+    static const double aWeight[] = {0.0448, 0.2856, 0.3001, 0.2363, 0.1333};
+    double cs, ssim = SsimPlane(p0, p1, nWidth, nHeight, nPitch, shift, nMax, &cs);
+    if (pSsim) {
+        *pSsim = ssim;
+    }
+    double msSsim = pow((std::max)(cs, 0.0), aWeight[0]);
+    nWidth /= 2;
+    nHeight /= 2;
+    // Kept per thread, so that measuring frame after frame doesn't allocate. The buffers trade
+    // places at each scale, so all of them are sized for the largest.
+    static thread_local std::vector<uint16_t> v0, v1, vHalf0, vHalf1;
+    const size_t nSize = (size_t)nWidth * nHeight;
+    if (v0.size() < nSize || vHalf0.size() < nSize) {
+        v0.resize(nSize);
+        v1.resize(nSize);
+        vHalf0.resize(nSize);
+        vHalf1.resize(nSize);
+    }
+    HalvePlane(p0, nPitch, shift, nWidth, nHeight, v0.data());
+    HalvePlane(p1, nPitch, shift, nWidth, nHeight, v1.data());
+    for (int iScale = 1; ; iScale++) {
+        ssim = SsimPlane(v0.data(), v1.data(), nWidth, nHeight, nWidth, 0, nMax, &cs);
+        if (iScale == 4) {
+            break;
+        }
+        msSsim *= pow((std::max)(cs, 0.0), aWeight[iScale]);
+        HalvePlane(v0.data(), nWidth, 0, nWidth / 2, nHeight / 2, vHalf0.data());
+        HalvePlane(v1.data(), nWidth, 0, nWidth / 2, nHeight / 2, vHalf1.data());
+        nWidth /= 2;
+        nHeight /= 2;
+        v0.swap(vHalf0);
+        v1.swap(vHalf1);
+    }
+    // The coarsest scale contributes its luminance term as well
+    return msSsim * pow((std::max)(ssim, 0.0), aWeight[4]);
+}
+
+/**
+* @brief SSIM of each plane of two packed 4:2:0 planar frames, plus MS-SSIM of the luma
+*/
+template <typename T>
+void SsimFor420Planar(const T *p0, const T *p1, int nWidth, int nHeight, int shift, int nMax, double *py, double *pu, double *pv, double *pMsSsimY) {
+    const int nChromaWidth = nWidth / 2, nChromaHeight = nHeight / 2;
+    const size_t nChromaSize = (size_t)nChromaWidth * nChromaHeight, nLumaSize = (size_t)nWidth * nHeight;
+    *pMsSsimY = MsSsimPlane(p0, p1, nWidth, nHeight, nWidth, shift, nMax, py);
+    *pu = SsimPlane(p0 + nLumaSize, p1 + nLumaSize, nChromaWidth, nChromaHeight, nChromaWidth, shift, nMax);
+    *pv = SsimPlane(p0 + nLumaSize + nChromaSize, p1 + nLumaSize + nChromaSize, nChromaWidth, nChromaHeight, nChromaWidth, shift, nMax);
+}
+
+/**
+* @brief SSIM of each plane of two packed 4:4:4 planar frames, plus MS-SSIM of the luma
+*/
+template <typename T>
+void SsimFor444Planar(const T *p0, const T *p1, int nWidth, int nHeight, int shift, int nMax, double *py, double *pu, double *pv, double *pMsSsimY) {
+    const size_t nPlaneSize = (size_t)nWidth * nHeight;
+    *pMsSsimY = MsSsimPlane(p0, p1, nWidth, nHeight, nWidth, shift, nMax, py);
+    *pu = SsimPlane(p0 + nPlaneSize, p1 + nPlaneSize, nWidth, nHeight, nWidth, shift, nMax);
+    *pv = SsimPlane(p0 + 2 * nPlaneSize, p1 + 2 * nPlaneSize, nWidth, nHeight, nWidth, shift, nMax);
+}
@@ -0,0 +1,440 @@
+/*
+* Copyright 2017-2018 NVIDIA Corporation.  All rights reserved.
+*
+* Please refer to the NVIDIA end user license agreement (EULA) associated
+* with this source code for terms and conditions that govern your use of
+* this software. Any use, reproduction, disclosure, or distribution of
+* this software and related documentation outside the terms of the EULA
+* is strictly prohibited.
+*
+*/
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <stdint.h>
+#include "../../Utils/NvCodecUtils.h"
+#include "../AppEncQual/PSNR.h"
+#include "../AppEncQual/SSIM.h"
+
+simplelogger::Logger *logger = simplelogger::LoggerFactory::CreateConsoleLogger();
+
+/**
+* @brief Layout of the frames being compared, 4:2:0 or 4:4:4 as in Y4mInfo. Samples are shifted
+* right by shift before the comparison, which leaves values up to nMax.
+*/
+struct CompareFormat {
+    const char *szName;
+    int nChroma;
+    bool bUVInterleaved;
+    int nBytesPerSample;
+    int shift;
+    int nMax;
+
+    int64_t GetChromaSize(int nWidth, int nHeight) const {
+        return nChroma == 444 ? (int64_t)nWidth * nHeight : (int64_t)(nWidth / 2) * (nHeight / 2);
+    }
+};
+
+static const CompareFormat aCompareFormat[] = {
+    {"iyuv", 420, false, 1, 0, 255},
+    {"nv12", 420, true, 1, 0, 255},
+    {"yuv420p16", 420, false, 2, 0, 65535},
+    {"p010", 420, true, 2, 6, 1023},
+    {"p016", 420, true, 2, 0, 65535},
+    {"yuv444", 444, false, 1, 0, 255},
+    {"yuv444p16", 444, false, 2, 0, 65535},
+};
+
+struct FrameResult {
+    int64_t aSse[3];
+    double aSsim[3];
+    double msSsim;
+};
+
+void ShowHelpAndExit(const char *szBadOption = NULL)
+{
+    bool bThrowError = false;
+    std::ostringstream oss;
+    if (szBadOption)
+    {
+        bThrowError = true;
+        oss << "Error parsing \"" << szBadOption << "\"" << std::endl;
+    }
+    oss << "Options:" << std::endl
+        << "-ref         Reference file path, raw or Y4M" << std::endl
+        << "-dist        Distorted file path, raw or Y4M" << std::endl
+        << "-s           Resolution in this form: WxH (taken from the header for Y4M)" << std::endl
+        << "-if          Format of raw files: iyuv nv12 yuv420p16 p010 p016 yuv444 yuv444p16" << std::endl
+        << "-ssim        Also compute SSIM of each plane and MS-SSIM of luma" << std::endl
+        << "-csv         Per-frame results as CSV to this path" << std::endl
+        << "-json        Per-frame results and summary as JSON to this path" << std::endl
+        << "-thread      Number of frames compared at once (default: one per CPU)" << std::endl
+        ;
+    if (bThrowError)
+    {
+        throw std::invalid_argument(oss.str());
+    }
+    else
+    {
+        std::cout << oss.str();
+        exit(0);
+    }
+}
+
+void ParseCommandLine(int argc, char *argv[], char *szRefFilePath, char *szDistFilePath, int &nWidth, int &nHeight,
+    int &iFormat, bool &bSsim, char *szCsvFilePath, char *szJsonFilePath, int &nThread)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (!_stricmp(argv[i], "-h"))
+        {
+            ShowHelpAndExit();
+        }
+        if (!_stricmp(argv[i], "-ref") || !_stricmp(argv[i], "-dist") || !_stricmp(argv[i], "-csv") || !_stricmp(argv[i], "-json"))
+        {
+            const char *szOption = argv[i];
+            if (++i == argc)
+            {
+                ShowHelpAndExit(szOption);
+            }
+            char *szPath = !_stricmp(szOption, "-ref") ? szRefFilePath : !_stricmp(szOption, "-dist") ? szDistFilePath
+                : !_stricmp(szOption, "-csv") ? szCsvFilePath : szJsonFilePath;
+            sprintf(szPath, "%s", argv[i]);
+            continue;
+        }
+        if (!_stricmp(argv[i], "-s"))
+        {
+            if (++i == argc || 2 != sscanf(argv[i], "%dx%d", &nWidth, &nHeight))
+            {
+                ShowHelpAndExit("-s");
+            }
+            continue;
+        }
+        if (!_stricmp(argv[i], "-if"))
+        {
+            if (++i == argc)
+            {
+                ShowHelpAndExit("-if");
+            }
+            iFormat = -1;
+            for (int j = 0; j < (int)(sizeof(aCompareFormat) / sizeof(aCompareFormat[0])); j++)
+            {
+                if (!_stricmp(argv[i], aCompareFormat[j].szName))
+                {
+                    iFormat = j;
+                }
+            }
+            if (iFormat < 0)
+            {
+                ShowHelpAndExit("-if");
+            }
+            continue;
+        }
+        if (!_stricmp(argv[i], "-ssim"))
+        {
+            bSsim = true;
+            continue;
+        }
+        if (!_stricmp(argv[i], "-thread"))
+        {
+            if (++i == argc || (nThread = atoi(argv[i])) <= 0)
+            {
+                ShowHelpAndExit("-thread");
+            }
+            continue;
+        }
+        ShowHelpAndExit(argv[i]);
+    }
+}
+
+/**
+*   @brief  SSIM of the three planes averaged by their number of samples, which for 4:2:0 is the
+*   usual (4 * y + u + v) / 6
+*/
+inline double GetSsimAverage(const double aSsim[3], int64_t nLuma, int64_t nChroma)
+{
+    return (nLuma * aSsim[0] + nChroma * (aSsim[1] + aSsim[2])) / (nLuma + 2 * nChroma);
+}
+
+/**
+*   @brief  Compares frames of the two readers, which must have their frame layout set, several
+*   frames at a time. The frames are split into min(nThread, nFrame) runs of consecutive frames, one
+*   per worker (no more than the pool has), so each worker reads its part of both files sequentially.
+*   PSNR reads the frames in place; only SSIM of interleaved frames needs them converted to planar.
+*/
+template <typename T>
+void CompareFrames(BufferedFileReader &refReader, BufferedFileReader &distReader, int nFrame, int nWidth, int nHeight,
+    const CompareFormat &format, bool bSsim, int nThread, std::vector<FrameResult> &vResult)
+{
+    const size_t nFrameSize = (size_t)nWidth * nHeight + 2 * (size_t)format.GetChromaSize(nWidth, nHeight);
+    auto CompareRange = [&](int iBegin, int iEnd) {
+        std::vector<T> vRefPlanar(format.bUVInterleaved && bSsim ? nFrameSize : 0), vDistPlanar(vRefPlanar.size());
+        YuvConverter<T> converter(nWidth, nHeight);
+        for (int iFrame = iBegin; iFrame < iEnd; iFrame++)
+        {
+            const T *pRef = (const T *)refReader.GetFrame(iFrame).pData, *pDist = (const T *)distReader.GetFrame(iFrame).pData;
+            FrameResult &result = vResult[iFrame];
+            if (format.nChroma == 444)
+            {
+                SumSquareErrorFor444Planar(pRef, nWidth, pDist, nWidth, nWidth, nHeight, &result.aSse[0], &result.aSse[1], &result.aSse[2], format.shift);
+            }
+            else if (format.bUVInterleaved)
+            {
+                SumSquareErrorFor420UVInterleaved(pRef, nWidth, pDist, nWidth, nWidth, nHeight, &result.aSse[0], &result.aSse[1], &result.aSse[2], format.shift);
+            }
+            else
+            {
+                SumSquareErrorFor420Planar(pRef, pDist, nWidth, nHeight, &result.aSse[0], &result.aSse[1], &result.aSse[2], format.shift);
+            }
+            if (!bSsim)
+            {
+                continue;
+            }
+            if (format.nChroma == 444)
+            {
+                SsimFor444Planar(pRef, pDist, nWidth, nHeight, format.shift, format.nMax,
+                    &result.aSsim[0], &result.aSsim[1], &result.aSsim[2], &result.msSsim);
+                continue;
+            }
+            if (format.bUVInterleaved)
+            {
+                converter.UVInterleavedToPlanar(pRef, 0, vRefPlanar.data(), 0);
+                converter.UVInterleavedToPlanar(pDist, 0, vDistPlanar.data(), 0);
+                pRef = vRefPlanar.data();
+                pDist = vDistPlanar.data();
+            }
+            SsimFor420Planar(pRef, pDist, nWidth, nHeight, format.shift, format.nMax,
+                &result.aSsim[0], &result.aSsim[1], &result.aSsim[2], &result.msSsim);
+        }
+    };
+    // With several runs the metrics inside each run on a single thread, as the pool is taken; with
+    // one, the whole range runs on the calling thread and the metrics split each frame themselves
+    HostWorkerPool &pool = HostWorkerPool::Get();
+    const int nRun = (std::min)((std::min)(nThread, nFrame), pool.GetThreadCount());
+    if (nRun <= 1 || !pool.Run(nRun, [&](int i) {
+        CompareRange((int)((int64_t)nFrame * i / nRun), (int)((int64_t)nFrame * (i + 1) / nRun));
+    }))
+    {
+        CompareRange(0, nFrame);
+    }
+}
+
+void WriteCsv(const char *szFilePath, const std::vector<FrameResult> &vResult, int nWidth, int nHeight, const CompareFormat &format, bool bSsim)
+{
+    std::ofstream fout(szFilePath);
+    if (!fout.is_open())
+    {
+        std::cout << "Unable to open output file: " << szFilePath << std::endl;
+        return;
+    }
+    const int64_t nLuma = (int64_t)nWidth * nHeight, nChroma = format.GetChromaSize(nWidth, nHeight);
+    const int nMax = format.nMax;
+    fout << "frame,mse_y,mse_u,mse_v,psnr_y,psnr_u,psnr_v,psnr_avg";
+    if (bSsim)
+    {
+        fout << ",ssim_y,ssim_u,ssim_v,ssim_avg,ms_ssim_y";
+    }
+    fout << "\n" << std::setprecision(6) << std::fixed;
+    for (size_t i = 0; i < vResult.size(); i++)
+    {
+        const FrameResult &r = vResult[i];
+        fout << i << "," << 1.0 * r.aSse[0] / nLuma << "," << 1.0 * r.aSse[1] / nChroma << "," << 1.0 * r.aSse[2] / nChroma
+            << "," << psnr(r.aSse[0], nLuma, nMax) << "," << psnr(r.aSse[1], nChroma, nMax) << "," << psnr(r.aSse[2], nChroma, nMax)
+            << "," << psnr(r.aSse[0] + r.aSse[1] + r.aSse[2], nLuma + 2 * nChroma, nMax);
+        if (bSsim)
+        {
+            fout << "," << r.aSsim[0] << "," << r.aSsim[1] << "," << r.aSsim[2]
+                << "," << GetSsimAverage(r.aSsim, nLuma, nChroma) << "," << r.msSsim;
+        }
+        fout << "\n";
+    }
+}
+
+/**
+*   @brief  Summary over all frames: PSNR from the total squared error like AppEncQual, the worst
+*   and best frame, and mean SSIM.
+*/
+struct CompareSummary {
+    double aPsnr[4], psnrMin, psnrMax;
+    double aSsim[4], ssimMin, msSsim;
+
+    CompareSummary(const std::vector<FrameResult> &vResult, int nWidth, int nHeight, const CompareFormat &format) {
+        const int64_t nLuma = (int64_t)nWidth * nHeight, nChroma = format.GetChromaSize(nWidth, nHeight), nFrame = (int64_t)vResult.size();
+        const int nMax = format.nMax;
+        int64_t aSse[3] = {}, nSseMin = INT64_MAX, nSseMax = 0;
+        double aSsimSum[4] = {}, msSsimSum = 0;
+        ssimMin = 1.0;
+        for (const FrameResult &r : vResult)
+        {
+            int64_t nSse = r.aSse[0] + r.aSse[1] + r.aSse[2];
+            nSseMin = (std::min)(nSseMin, nSse);
+            nSseMax = (std::max)(nSseMax, nSse);
+            double ssim = GetSsimAverage(r.aSsim, nLuma, nChroma);
+            ssimMin = (std::min)(ssimMin, ssim);
+            for (int i = 0; i < 3; i++)
+            {
+                aSse[i] += r.aSse[i];
+                aSsimSum[i] += r.aSsim[i];
+            }
+            aSsimSum[3] += ssim;
+            msSsimSum += r.msSsim;
+        }
+        aPsnr[0] = psnr(aSse[0], nLuma * nFrame, nMax);
+        aPsnr[1] = psnr(aSse[1], nChroma * nFrame, nMax);
+        aPsnr[2] = psnr(aSse[2], nChroma * nFrame, nMax);
+        aPsnr[3] = psnr(aSse[0] + aSse[1] + aSse[2], (nLuma + 2 * nChroma) * nFrame, nMax);
+        psnrMin = psnr(nSseMax, nLuma + 2 * nChroma, nMax);
+        psnrMax = psnr(nSseMin, nLuma + 2 * nChroma, nMax);
+        for (int i = 0; i < 4; i++)
+        {
+            aSsim[i] = aSsimSum[i] / nFrame;
+        }
+        msSsim = msSsimSum / nFrame;
+    }
+};
+
+void WriteJson(const char *szFilePath, const std::vector<FrameResult> &vResult, const CompareSummary &summary, int nWidth, int nHeight, const CompareFormat &format, bool bSsim)
+{
+    std::ofstream fout(szFilePath);
+    if (!fout.is_open())
+    {
+        std::cout << "Unable to open output file: " << szFilePath << std::endl;
+        return;
+    }
+    const int64_t nLuma = (int64_t)nWidth * nHeight, nChroma = format.GetChromaSize(nWidth, nHeight);
+    const int nMax = format.nMax;
+    fout << std::setprecision(6) << std::fixed;
+    fout << "{\n  \"width\": " << nWidth << ",\n  \"height\": " << nHeight << ",\n  \"frames\": [";
+    for (size_t i = 0; i < vResult.size(); i++)
+    {
+        const FrameResult &r = vResult[i];
+        fout << (i ? ",\n" : "\n") << "    {\"frame\": " << i
+            << ", \"psnr_y\": " << psnr(r.aSse[0], nLuma, nMax)
+            << ", \"psnr_u\": " << psnr(r.aSse[1], nChroma, nMax)
+            << ", \"psnr_v\": " << psnr(r.aSse[2], nChroma, nMax)
+            << ", \"psnr_avg\": " << psnr(r.aSse[0] + r.aSse[1] + r.aSse[2], nLuma + 2 * nChroma, nMax);
+        if (bSsim)
+        {
+            fout << ", \"ssim_y\": " << r.aSsim[0] << ", \"ssim_u\": " << r.aSsim[1] << ", \"ssim_v\": " << r.aSsim[2]
+                << ", \"ssim_avg\": " << GetSsimAverage(r.aSsim, nLuma, nChroma) << ", \"ms_ssim_y\": " << r.msSsim;
+        }
+        fout << "}";
+    }
+    fout << "\n  ],\n  \"summary\": {\"frames\": " << vResult.size()
+        << ", \"psnr_y\": " << summary.aPsnr[0] << ", \"psnr_u\": " << summary.aPsnr[1] << ", \"psnr_v\": " << summary.aPsnr[2]
+        << ", \"psnr_avg\": " << summary.aPsnr[3] << ", \"psnr_min\": " << summary.psnrMin << ", \"psnr_max\": " << summary.psnrMax;
+    if (bSsim)
+    {
+        fout << ", \"ssim_y\": " << summary.aSsim[0] << ", \"ssim_u\": " << summary.aSsim[1] << ", \"ssim_v\": " << summary.aSsim[2]
+            << ", \"ssim_avg\": " << summary.aSsim[3] << ", \"ssim_min\": " << summary.ssimMin << ", \"ms_ssim_y\": " << summary.msSsim;
+    }
+    fout << "}\n}\n";
+}
+
+/**
+*  This sample application compares two existing 4:2:0 or 4:4:4 YUV files, raw or Y4M, frame by frame,
+*  without running the encoder. Both files are memory-mapped and several frames are compared at
+*  once, one per CPU, so a comparison runs about as fast as the files can be read. PSNR, and with
+*  "-ssim" SSIM and MS-SSIM, are reported as a summary, and per frame with "-csv" or "-json".
+*/
+int main(int argc, char **argv)
+{
+    char szRefFilePath[256] = "", szDistFilePath[256] = "", szCsvFilePath[256] = "", szJsonFilePath[256] = "";
+    int nWidth = 1920, nHeight = 1080, iFormat = 0, nThread = HostWorkerPool::Get().GetThreadCount();
+    bool bSsim = false;
+    try
+    {
+        ParseCommandLine(argc, argv, szRefFilePath, szDistFilePath, nWidth, nHeight, iFormat, bSsim, szCsvFilePath, szJsonFilePath, nThread);
+        CheckInputFile(szRefFilePath);
+        CheckInputFile(szDistFilePath);
+
+        BufferedFileReader refReader(szRefFilePath), distReader(szDistFilePath);
+        CompareFormat format = aCompareFormat[iFormat];
+        // Y4M input carries its resolution and bit depth, which take precedence over -s and -if;
+        // deeper samples are stored in the low bits of 2 bytes
+        const Y4mInfo *pY4mInfo = refReader.GetY4mInfo() ? refReader.GetY4mInfo() : distReader.GetY4mInfo();
+        if (pY4mInfo)
+        {
+            if (pY4mInfo->nChroma != 420 && pY4mInfo->nChroma != 444)
+            {
+                std::cout << "Unsupported Y4M color space" << std::endl;
+                return 1;
+            }
+            nWidth = pY4mInfo->nWidth;
+            nHeight = pY4mInfo->nHeight;
+            const bool b444 = pY4mInfo->nChroma == 444, bDeep = pY4mInfo->nBitDepth > 8;
+            format = aCompareFormat[b444 ? (bDeep ? 6 : 5) : (bDeep ? 2 : 0)];
+            format.nMax = (1 << pY4mInfo->nBitDepth) - 1;
+        }
+        if (nWidth <= 0 || nHeight <= 0 || (format.nChroma == 420 && (nWidth % 2 || nHeight % 2)))
+        {
+            std::cout << "Width and height must be positive, and even for 4:2:0" << std::endl;
+            return 1;
+        }
+        const uint64_t nFrameSize = ((uint64_t)nWidth * nHeight + 2 * (uint64_t)format.GetChromaSize(nWidth, nHeight)) * format.nBytesPerSample;
+        refReader.SetFrameLayout(nFrameSize);
+        distReader.SetFrameLayout(nFrameSize);
+        const int nFrame = (int)(std::min)(refReader.GetFrameCount(), distReader.GetFrameCount());
+        if (refReader.GetFrameCount() != distReader.GetFrameCount())
+        {
+            std::cout << "Frame counts differ (" << refReader.GetFrameCount() << " and " << distReader.GetFrameCount()
+                << "); comparing the first " << nFrame << std::endl;
+        }
+        if (!nFrame)
+        {
+            std::cout << "No frames to compare" << std::endl;
+            return 1;
+        }
+
+        std::vector<FrameResult> vResult(nFrame);
+        StopWatch w;
+        w.Start();
+        if (format.nBytesPerSample == 2)
+        {
+            CompareFrames<uint16_t>(refReader, distReader, nFrame, nWidth, nHeight, format, bSsim, nThread, vResult);
+        }
+        else
+        {
+            CompareFrames<uint8_t>(refReader, distReader, nFrame, nWidth, nHeight, format, bSsim, nThread, vResult);
+        }
+        double sec = w.Stop();
+
+        CompareSummary summary(vResult, nWidth, nHeight, format);
+        std::cout << std::setprecision(6) << std::fixed;
+        std::cout << "PSNR y:" << summary.aPsnr[0]
+            << " u:" << summary.aPsnr[1]
+            << " v:" << summary.aPsnr[2]
+            << " average:" << summary.aPsnr[3]
+            << " min:" << summary.psnrMin
+            << " max:" << summary.psnrMax
+            << std::endl;
+        if (bSsim)
+        {
+            std::cout << "SSIM y:" << summary.aSsim[0]
+                << " u:" << summary.aSsim[1]
+                << " v:" << summary.aSsim[2]
+                << " average:" << summary.aSsim[3]
+                << " min:" << summary.ssimMin
+                << " MS-SSIM y:" << summary.msSsim
+                << std::endl;
+        }
+        std::cout << std::setprecision(2) << "Frames compared: " << nFrame << " in " << sec << " s ("
+            << nFrame / sec << " fps, " << 2.0 * nFrameSize * nFrame / sec / (1 << 20) << " MB/s)" << std::endl;
+
+        if (*szCsvFilePath)
+        {
+            WriteCsv(szCsvFilePath, vResult, nWidth, nHeight, format, bSsim);
+        }
+        if (*szJsonFilePath)
+        {
+            WriteJson(szJsonFilePath, vResult, summary, nWidth, nHeight, format, bSsim);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cout << e.what();
+    }
+    return 0;
+}
@@ -173,6 +173,7 @@ int main(int argc, char **argv) {
 
         // Output device frame
         FFmpegDemuxer demuxer(szInFilePath);
+        demuxer.StartPrefetch();
         NvDecoder dec(cuContext, demuxer.GetWidth(), demuxer.GetHeight(), true, FFmpeg2NvCodecId(demuxer.GetVideoCodec()), nullptr, false, true);
 
         int nVideoBytes = 0, nFrameReturned = 0, nFrame = 0;
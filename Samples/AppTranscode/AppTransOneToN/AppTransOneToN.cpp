@@ -298,6 +298,7 @@ int main(int argc, char *argv[])
         ck(cuCtxCreate(&cuContext, 0, cuDevice));
 
         FFmpegDemuxer demuxer(szInFilePath);
+        demuxer.StartPrefetch();
         int nEnc = (int)vResolution.size();
         for (int i = 0; i < nEnc; i++)
         {
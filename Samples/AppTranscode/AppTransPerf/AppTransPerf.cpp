@@ -247,8 +247,8 @@ int main(int argc, char **argv)
 
         CheckInputFile(szInFilePath);
 
-        uint8_t *pBuf = NULL;
-        uint32_t nBufSize = 0;
+        const uint8_t *pBuf = NULL;
+        uint64_t nBufSize = 0;
         BufferedFileReader bufferedFileReader(szInFilePath);
         if (!bufferedFileReader.GetBuffer(&pBuf, &nBufSize)) {
             std::cout << "Failed to read file" << std::endl;
@@ -0,0 +1,429 @@
+/*
+* Copyright 2017-2018 NVIDIA Corporation.  All rights reserved.
+*
+* Please refer to the NVIDIA end user license agreement (EULA) associated
+* with this source code for terms and conditions that govern your use of
+* this software. Any use, reproduction, disclosure, or distribution of
+* this software and related documentation outside the terms of the EULA
+* is strictly prohibited.
+*
+*/
+#pragma once
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ES_DEMUXER_SSE2
+#endif
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include <vector>
+#include <limits.h>
+extern "C" {
+#include <libavcodec/avcodec.h>
+}
+#include "NvCodecUtils.h"
+
+/**
+* @brief Demuxer for raw Annex-B H.264/HEVC elementary streams. The file is memory mapped and
+* split into access units by scanning start codes directly, without libavformat probing or
+* parsing. The interface mirrors FFmpegDemuxer so that it can be used as a drop-in replacement;
+* apps pick it for files that IsElementaryStreamFile() accepts.
+*/
+class ElementaryStreamDemuxer {
+private:
+    MappedFile file;
+    const uint8_t *pCur = NULL, *pEnd = NULL;
+
+    AVCodecID eVideoCodec = AV_CODEC_ID_NONE;
+    int nWidth = 0, nHeight = 0, nBitDepth = 8;
+
+    /**
+    *   @brief  Exp-Golomb bit reader over an RBSP (emulation prevention bytes removed).
+    */
+    class BitReader {
+    public:
+        BitReader(const uint8_t *pNal, int nNal) {
+            vRbsp.reserve(nNal);
+            for (int i = 0; i < nNal; i++) {
+                if (i >= 2 && pNal[i] == 3 && pNal[i - 1] == 0 && pNal[i - 2] == 0) {
+                    continue;
+                }
+                vRbsp.push_back(pNal[i]);
+            }
+        }
+        uint32_t U(int n) {
+            uint32_t v = 0;
+            for (int i = 0; i < n; i++) {
+                v = (v << 1) | Bit();
+            }
+            return v;
+        }
+        uint32_t UE() {
+            int nLeadingZero = 0;
+            while (!Bit() && nLeadingZero < 32) {
+                nLeadingZero++;
+            }
+            return nLeadingZero ? ((1u << nLeadingZero) - 1 + U(nLeadingZero)) : 0;
+        }
+        int32_t SE() {
+            uint32_t v = UE();
+            return v & 1 ? (int32_t)((v + 1) / 2) : -(int32_t)(v / 2);
+        }
+        void Skip(int n) {
+            iBit += n;
+        }
+
+    private:
+        uint32_t Bit() {
+            if (iBit >= vRbsp.size() * 8) {
+                return 0;
+            }
+            uint32_t b = (vRbsp[iBit / 8] >> (7 - iBit % 8)) & 1;
+            iBit++;
+            return b;
+        }
+        std::vector<uint8_t> vRbsp;
+        size_t iBit = 0;
+    };
+
+public:
+    ElementaryStreamDemuxer(const char *szFilePath) : file(szFilePath) {
+        if (!file.GetData()) {
+            LOG(ERROR) << "Unable to read elementary stream: " << szFilePath;
+            return;
+        }
+        pCur = file.GetData();
+        pEnd = pCur + file.GetSize();
+
+        eVideoCodec = ProbeCodec(szFilePath);
+        if (eVideoCodec == AV_CODEC_ID_NONE) {
+            LOG(ERROR) << "Not an Annex-B H.264/HEVC elementary stream: " << szFilePath;
+            pCur = pEnd;
+            return;
+        }
+
+        // Geometry and bit depth come from the first SPS
+        for (const uint8_t *p = FindStartCode(pCur, pEnd); p < pEnd; ) {
+            const uint8_t *pNal = p + 3;
+            const uint8_t *pNext = FindStartCode(pNal, pEnd);
+            if (pNal < pEnd && GetNalType(pNal) == (eVideoCodec == AV_CODEC_ID_H264 ? 7 : 33)) {
+                // Drop the zero_byte of a following 4-byte start code and any trailing_zero_8bits;
+                // the RBSP itself ends with a stop bit, so its last byte is never zero
+                const uint8_t *pNalEnd = pNext;
+                while (pNalEnd > pNal && !pNalEnd[-1]) {
+                    pNalEnd--;
+                }
+                if (eVideoCodec == AV_CODEC_ID_H264) {
+                    ParseH264Sps(pNal + 1, (int)(pNalEnd - pNal - 1));
+                } else {
+                    ParseHevcSps(pNal + 2, (int)(pNalEnd - pNal - 2));
+                }
+                break;
+            }
+            p = pNext;
+        }
+        LOG(INFO) << "Media format: " << (eVideoCodec == AV_CODEC_ID_H264 ? "H.264" : "HEVC") << " elementary stream";
+    }
+    /**
+    *   @brief  Tells by the extension whether szFilePath names a raw H.264/HEVC elementary stream
+    */
+    static bool IsElementaryStreamFile(const char *szFilePath) {
+        return GetCodecFromExtension(szFilePath) != AV_CODEC_ID_NONE;
+    }
+    AVCodecID GetVideoCodec() {
+        return eVideoCodec;
+    }
+    int GetWidth() {
+        return nWidth;
+    }
+    int GetHeight() {
+        return nHeight;
+    }
+    int GetBitDepth() {
+        return nBitDepth;
+    }
+    int GetFrameSize() {
+        return nBitDepth == 8 ? nWidth * nHeight * 3 / 2: nWidth * nHeight * 3;
+    }
+    /**
+    *   @brief  An elementary stream carries no container timing, so the frame rate is unknown
+    */
+    bool GetFrameRate(int *pnNum, int *pnDen) {
+        return false;
+    }
+    /**
+    *   @brief  Nothing to do: Demux() hands out views into the mapped file, and the OS reads the
+    *   file ahead as it is scanned sequentially. Kept for parity with FFmpegDemuxer.
+    */
+    void StartPrefetch(int nMaxPackets = 64, int nMaxBytes = 64 * 1024 * 1024) {
+    }
+    /**
+    *   @brief  Returns the next access unit. The data points into the mapped file and stays
+    *   valid for the lifetime of the demuxer.
+    */
+    bool Demux(uint8_t **ppVideo, int *pnVideoBytes) {
+        *pnVideoBytes = 0;
+
+        const uint8_t *pStart = FindStartCode(pCur, pEnd);
+        if (pStart >= pEnd) {
+            pCur = pEnd;
+            return false;
+        }
+
+        bool bVcl = false;
+        const uint8_t *p = pStart;
+        while (p < pEnd) {
+            const uint8_t *pNal = p + 3;
+            const uint8_t *pNext = FindStartCode(pNal, pEnd);
+            if (pNal < pEnd && pNext > pNal) {
+                if (bVcl && IsAccessUnitStart(pNal, (int)(pNext - pNal))) {
+                    break;
+                }
+                bVcl = bVcl || IsVcl(pNal);
+            }
+            p = pNext;
+        }
+
+        // Keep the leading zero_byte of a 4-byte start code with the unit it belongs to
+        if (pStart > file.GetData() && !pStart[-1]) {
+            pStart--;
+        }
+        const uint8_t *pAuEnd = p;
+        if (pAuEnd < pEnd && pAuEnd > pStart && !pAuEnd[-1]) {
+            pAuEnd--;
+        }
+
+        *ppVideo = (uint8_t *)pStart;
+        *pnVideoBytes = (int)(pAuEnd - pStart);
+        pCur = p;
+        return true;
+    }
+
+    /**
+    *   @brief  Like FFmpegDemuxer::DemuxBatch(), up to nMaxPackets access units as one Annex-B
+    *   buffer; consecutive access units are contiguous in the file, so no copy is made.
+    *   anPacketBytes (optional, nMaxPackets entries) receives the size of each access unit.
+    */
+    int DemuxBatch(uint8_t **ppVideo, int *pnVideoBytes, int *anPacketBytes, int nMaxPackets, int nMaxBytes = INT_MAX) {
+        uint8_t *pVideo = NULL, *pUnit = NULL, *pBatchEnd = NULL;
+        int nPacket = 0, nUnitBytes = 0;
+        while (nPacket < nMaxPackets && pBatchEnd - pVideo < nMaxBytes && Demux(&pUnit, &nUnitBytes)) {
+            if (!nPacket) {
+                pVideo = pUnit;
+            }
+            // Anything between two units is trailing_zero_8bits, which may stay in the batch
+            pBatchEnd = pUnit + nUnitBytes;
+            if (anPacketBytes) {
+                anPacketBytes[nPacket] = nUnitBytes;
+            }
+            nPacket++;
+        }
+        *ppVideo = pVideo;
+        *pnVideoBytes = (int)(pBatchEnd - pVideo);
+        return nPacket;
+    }
+
+private:
+    /**
+    *   @brief  Returns the position of the next 00 00 01 at or after p, or pEnd if there is none.
+    */
+    static const uint8_t *FindStartCode(const uint8_t *p, const uint8_t *pEnd) {
+#ifdef ES_DEMUXER_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        for (; pEnd - p >= 18; p += 16) {
+            // Bit i is set where p[i] and p[i + 1] are both zero
+            int m = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)p), zero))
+                & _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(p + 1)), zero));
+            while (m) {
+                int i = CountTrailingZeros(m);
+                if (p[i + 2] == 1) {
+                    return p + i;
+                }
+                m &= m - 1;
+            }
+        }
+#endif
+        for (; pEnd - p >= 3; p++) {
+            if (!p[0] && !p[1] && p[2] == 1) {
+                return p;
+            }
+        }
+        return pEnd;
+    }
+#ifdef ES_DEMUXER_SSE2
+    static int CountTrailingZeros(int m) {
+#ifdef _MSC_VER
+        unsigned long i;
+        _BitScanForward(&i, m);
+        return (int)i;
+#else
+        return __builtin_ctz(m);
+#endif
+    }
+#endif
+
+    int GetNalType(const uint8_t *pNal) {
+        return eVideoCodec == AV_CODEC_ID_H264 ? pNal[0] & 0x1F : (pNal[0] >> 1) & 0x3F;
+    }
+
+    bool IsVcl(const uint8_t *pNal) {
+        int eType = GetNalType(pNal);
+        return eVideoCodec == AV_CODEC_ID_H264 ? (eType >= 1 && eType <= 5) : eType < 32;
+    }
+
+    /**
+    *   @brief  Tells whether the NAL unit begins a new access unit, given that the current
+    *   access unit already holds a VCL NAL unit (H.264 7.4.1.2.3, HEVC 7.4.2.4.4).
+    */
+    bool IsAccessUnitStart(const uint8_t *pNal, int nNal) {
+        int eType = GetNalType(pNal);
+        if (eVideoCodec == AV_CODEC_ID_H264) {
+            if (eType >= 1 && eType <= 5) {
+                // first_mb_in_slice == 0 is coded as a single '1' bit
+                return nNal > 1 && (pNal[1] & 0x80);
+            }
+            return (eType >= 6 && eType <= 9) || (eType >= 14 && eType <= 18);
+        }
+        if (eType < 32) {
+            // first_slice_segment_in_pic_flag
+            return nNal > 2 && (pNal[2] & 0x80);
+        }
+        return (eType >= 32 && eType <= 35) || eType == 39 || (eType >= 41 && eType <= 44) || (eType >= 48 && eType <= 55);
+    }
+
+    static AVCodecID GetCodecFromExtension(const char *szFilePath) {
+        const char *szExt = strrchr(szFilePath, '.');
+        if (szExt) {
+            if (!_stricmp(szExt, ".h264") || !_stricmp(szExt, ".264") || !_stricmp(szExt, ".avc")) {
+                return AV_CODEC_ID_H264;
+            }
+            if (!_stricmp(szExt, ".hevc") || !_stricmp(szExt, ".h265") || !_stricmp(szExt, ".265")) {
+                return AV_CODEC_ID_HEVC;
+            }
+        }
+        return AV_CODEC_ID_NONE;
+    }
+
+    AVCodecID ProbeCodec(const char *szFilePath) {
+        AVCodecID eCodec = GetCodecFromExtension(szFilePath);
+        if (eCodec != AV_CODEC_ID_NONE) {
+            return eCodec;
+        }
+
+        // Look at the NAL header following the first start code
+        const uint8_t *p = FindStartCode(pCur, pEnd);
+        if (pEnd - p < 5 || (p[3] & 0x80)) {
+            return AV_CODEC_ID_NONE;
+        }
+        int eHevcType = (p[3] >> 1) & 0x3F;
+        if (((eHevcType >= 32 && eHevcType <= 35) || eHevcType == 39) && (p[4] & 7)) {
+            return AV_CODEC_ID_HEVC;
+        }
+        int eH264Type = p[3] & 0x1F;
+        if (eH264Type >= 1 && eH264Type <= 9) {
+            return AV_CODEC_ID_H264;
+        }
+        return AV_CODEC_ID_NONE;
+    }
+
+    void ParseH264Sps(const uint8_t *pRbsp, int nRbsp) {
+        BitReader br(pRbsp, nRbsp);
+        int iProfile = br.U(8);
+        br.Skip(16);
+        br.UE();
+        int iChromaFormat = 1;
+        bool bSeparateColourPlane = false;
+        if (iProfile == 100 || iProfile == 110 || iProfile == 122 || iProfile == 244 || iProfile == 44 || iProfile == 83
+            || iProfile == 86 || iProfile == 118 || iProfile == 128 || iProfile == 138 || iProfile == 139 || iProfile == 134 || iProfile == 135) {
+            iChromaFormat = br.UE();
+            if (iChromaFormat == 3) {
+                bSeparateColourPlane = br.U(1) != 0;
+            }
+            nBitDepth = br.UE() + 8;
+            br.UE();
+            br.Skip(1);
+            if (br.U(1)) {
+                for (int i = 0; i < (iChromaFormat != 3 ? 8 : 12); i++) {
+                    if (!br.U(1)) {
+                        continue;
+                    }
+                    int nLastScale = 8, nNextScale = 8;
+                    for (int j = 0; j < (i < 6 ? 16 : 64) && nNextScale; j++) {
+                        nNextScale = (nLastScale + br.SE() + 256) % 256;
+                        nLastScale = nNextScale ? nNextScale : nLastScale;
+                    }
+                }
+            }
+        }
+        br.UE();
+        int iPocType = br.UE();
+        if (iPocType == 0) {
+            br.UE();
+        } else if (iPocType == 1) {
+            br.Skip(1);
+            br.SE();
+            br.SE();
+            for (int i = br.UE(); i > 0; i--) {
+                br.SE();
+            }
+        }
+        br.UE();
+        br.Skip(1);
+        int nWidthInMbs = br.UE() + 1;
+        int nHeightInMapUnits = br.UE() + 1;
+        int bFrameMbsOnly = br.U(1);
+        if (!bFrameMbsOnly) {
+            br.Skip(1);
+        }
+        br.Skip(1);
+        int nCropLeft = 0, nCropRight = 0, nCropTop = 0, nCropBottom = 0;
+        if (br.U(1)) {
+            nCropLeft = br.UE();
+            nCropRight = br.UE();
+            nCropTop = br.UE();
+            nCropBottom = br.UE();
+        }
+
+        int nChromaArrayType = bSeparateColourPlane ? 0 : iChromaFormat;
+        int nCropUnitX = nChromaArrayType == 0 ? 1 : (nChromaArrayType == 3 ? 1 : 2);
+        int nCropUnitY = (nChromaArrayType == 1 ? 2 : 1) * (2 - bFrameMbsOnly);
+        nWidth = nWidthInMbs * 16 - nCropUnitX * (nCropLeft + nCropRight);
+        nHeight = (2 - bFrameMbsOnly) * nHeightInMapUnits * 16 - nCropUnitY * (nCropTop + nCropBottom);
+    }
+
+    void ParseHevcSps(const uint8_t *pRbsp, int nRbsp) {
+        BitReader br(pRbsp, nRbsp);
+        br.Skip(4);
+        int nMaxSubLayersMinus1 = br.U(3);
+        br.Skip(1);
+        // profile_tier_level(): general profile/tier/flags and level_idc
+        br.Skip(96);
+        bool abSubLayerProfile[8] = {}, abSubLayerLevel[8] = {};
+        for (int i = 0; i < nMaxSubLayersMinus1; i++) {
+            abSubLayerProfile[i] = br.U(1) != 0;
+            abSubLayerLevel[i] = br.U(1) != 0;
+        }
+        if (nMaxSubLayersMinus1 > 0) {
+            br.Skip(2 * (8 - nMaxSubLayersMinus1));
+        }
+        for (int i = 0; i < nMaxSubLayersMinus1; i++) {
+            br.Skip((abSubLayerProfile[i] ? 88 : 0) + (abSubLayerLevel[i] ? 8 : 0));
+        }
+        br.UE();
+        int iChromaFormat = br.UE();
+        if (iChromaFormat == 3) {
+            br.Skip(1);
+        }
+        nWidth = br.UE();
+        nHeight = br.UE();
+        if (br.U(1)) {
+            int nSubWidth = (iChromaFormat == 1 || iChromaFormat == 2) ? 2 : 1;
+            int nSubHeight = iChromaFormat == 1 ? 2 : 1;
+            int nLeft = br.UE(), nRight = br.UE(), nTop = br.UE(), nBottom = br.UE();
+            nWidth -= nSubWidth * (nLeft + nRight);
+            nHeight -= nSubHeight * (nTop + nBottom);
+        }
+        nBitDepth = br.UE() + 8;
+    }
+};
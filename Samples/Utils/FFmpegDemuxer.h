@@ -15,17 +15,169 @@ extern "C" {
 #include <libavformat/avio.h>
 #include <libavcodec/avcodec.h>
 }
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 #include "NvCodecUtils.h"
 
+/**
+* @brief Converts length-prefixed (AVCC/HVCC) H.264 and HEVC packets, as stored in MP4/MOV/FLV/MKV,
+* to the Annex-B byte stream expected by NVDEC. With 4-byte length fields the prefixes are turned
+* into start codes in place; a new buffer is only allocated for keyframes, which get the parameter
+* sets from extradata prepended, and for shorter length fields.
+*/
+class AnnexBConverter {
+public:
+    /**
+    *   @brief  Returns NULL if the stream does not need conversion, i.e. it is not H.264/HEVC or
+    *   its extradata is missing or already in Annex-B form.
+    */
+    static AnnexBConverter *Create(const AVCodecParameters *par) {
+        const uint8_t *p = par->extradata;
+        int n = par->extradata_size;
+        if ((par->codec_id != AV_CODEC_ID_H264 && par->codec_id != AV_CODEC_ID_HEVC) || n < 7
+            || (!p[0] && !p[1] && (p[2] == 1 || (!p[2] && p[3] == 1)))) {
+            return NULL;
+        }
+
+        std::unique_ptr<AnnexBConverter> pConverter(new AnnexBConverter());
+        if (!(par->codec_id == AV_CODEC_ID_H264 ? pConverter->ParseAvcC(p, n) : pConverter->ParseHvcC(p, n))) {
+            LOG(ERROR) << "Invalid " << (par->codec_id == AV_CODEC_ID_H264 ? "avcC" : "hvcC") << " extradata";
+            return NULL;
+        }
+        return pConverter.release();
+    }
+
+    /**
+    *   @brief  Returns false, leaving the packet untouched, if its NAL units overrun it or the
+    *   output can't be allocated; such a packet must not be passed to the decoder.
+    */
+    bool Convert(AVPacket *pPkt) {
+        // The whole packet is checked before anything is rewritten in place
+        int nOut = 0;
+        for (const uint8_t *p = pPkt->data, *pEnd = pPkt->data + pPkt->size; p < pEnd; ) {
+            if (pEnd - p < nLengthSize || ReadLength(p) > (uint32_t)(pEnd - p - nLengthSize)) {
+                LOG(WARNING) << "Truncated NAL unit in packet";
+                return false;
+            }
+            nOut += 4 + ReadLength(p);
+            p += nLengthSize + ReadLength(p);
+        }
+
+        bool bInsertParameterSets = (pPkt->flags & AV_PKT_FLAG_KEY) && !vParameterSets.empty();
+        if (nLengthSize == 4 && !bInsertParameterSets && pPkt->buf && av_buffer_is_writable(pPkt->buf)) {
+            for (uint8_t *p = pPkt->data, *pEnd = pPkt->data + pPkt->size; p < pEnd; ) {
+                uint32_t nNal = ReadLength(p);
+                p[0] = p[1] = p[2] = 0;
+                p[3] = 1;
+                p += 4 + nNal;
+            }
+            return true;
+        }
+
+        if (bInsertParameterSets) {
+            nOut += (int)vParameterSets.size();
+        }
+
+        AVPacket pktOut;
+        av_init_packet(&pktOut);
+        if (!ck(av_new_packet(&pktOut, nOut))) {
+            return false;
+        }
+        uint8_t *q = pktOut.data;
+        if (bInsertParameterSets) {
+            memcpy(q, vParameterSets.data(), vParameterSets.size());
+            q += vParameterSets.size();
+        }
+        for (const uint8_t *p = pPkt->data, *pEnd = pPkt->data + pPkt->size; p < pEnd; ) {
+            uint32_t nNal = ReadLength(p);
+            q[0] = q[1] = q[2] = 0;
+            q[3] = 1;
+            memcpy(q + 4, p + nLengthSize, nNal);
+            q += 4 + nNal;
+            p += nLengthSize + nNal;
+        }
+        av_packet_copy_props(&pktOut, pPkt);
+        av_packet_unref(pPkt);
+        av_packet_move_ref(pPkt, &pktOut);
+        return true;
+    }
+
+private:
+    AnnexBConverter() {}
+
+    uint32_t ReadLength(const uint8_t *p) {
+        uint32_t n = 0;
+        for (int i = 0; i < nLengthSize; i++) {
+            n = (n << 8) | p[i];
+        }
+        return n;
+    }
+
+    bool AppendParameterSets(const uint8_t **pp, const uint8_t *pEnd, int nSet) {
+        const uint8_t *p = *pp;
+        for (int i = 0; i < nSet; i++) {
+            if (pEnd - p < 2 || pEnd - p - 2 < (p[0] << 8 | p[1])) {
+                return false;
+            }
+            int nNal = p[0] << 8 | p[1];
+            const uint8_t startCode[] = {0, 0, 0, 1};
+            vParameterSets.insert(vParameterSets.end(), startCode, startCode + 4);
+            vParameterSets.insert(vParameterSets.end(), p + 2, p + 2 + nNal);
+            p += 2 + nNal;
+        }
+        *pp = p;
+        return true;
+    }
+
+    bool ParseAvcC(const uint8_t *pExtradata, int nExtradata) {
+        const uint8_t *p = pExtradata + 5, *pEnd = pExtradata + nExtradata;
+        nLengthSize = (pExtradata[4] & 3) + 1;
+        if (nLengthSize == 3 || !AppendParameterSets(&p, pEnd, *p++ & 0x1F) || p >= pEnd) {
+            return false;
+        }
+        return AppendParameterSets(&p, pEnd, *p++);
+    }
+
+    bool ParseHvcC(const uint8_t *pExtradata, int nExtradata) {
+        if (nExtradata < 23) {
+            return false;
+        }
+        const uint8_t *p = pExtradata + 23, *pEnd = pExtradata + nExtradata;
+        nLengthSize = (pExtradata[21] & 3) + 1;
+        for (int i = 0; i < pExtradata[22]; i++) {
+            if (pEnd - p < 3) {
+                return false;
+            }
+            int nSet = p[1] << 8 | p[2];
+            p += 3;
+            if (!AppendParameterSets(&p, pEnd, nSet)) {
+                return false;
+            }
+        }
+        return nLengthSize != 3;
+    }
+
+    int nLengthSize = 4;
+    // VPS/SPS/PPS from extradata, with start codes
+    std::vector<uint8_t> vParameterSets;
+};
+
 class FFmpegDemuxer {
 private:
     AVFormatContext *fmtc = NULL;
     AVIOContext *avioc = NULL;
-    AVPacket pkt, pktFiltered;
-    AVBSFContext *bsfc = NULL;
+    AVPacket pkt;
+    std::unique_ptr<AnnexBConverter> pAnnexBConverter;
 
     int iVideoStream;
-    bool bMp4H264;
+    // All video streams of the input, for multi-stream demuxing
+    std::vector<int> viVideoStream;
     AVCodecID eVideoCodec;
     int nWidth, nHeight, nBitDepth;
 
@@ -34,10 +186,133 @@ public:
     public:
         virtual ~DataProvider() {}
         virtual int GetData(uint8_t *pBuf, int nBuf) = 0;
+        /**
+        *   @brief  Optional random access: moves the read position as fseek() does (iWhence is
+        *   SEEK_SET, SEEK_CUR or SEEK_END) and returns the new position, or a negative value if the
+        *   source cannot seek. A seekable source must at least answer Seek(0, SEEK_CUR); it lets
+        *   the demuxer read MP4 files with the moov atom at the end through ranged reads.
+        */
+        virtual int64_t Seek(int64_t nOffset, int iWhence) {
+            return -1;
+        }
+        /**
+        *   @brief  Optional total size of the source in bytes, or a negative value if unknown.
+        */
+        virtual int64_t GetSize() {
+            return -1;
+        }
+    };
+
+    /**
+    *   @brief  Options for opening an input. With bFastOpen set, format probing and stream analysis
+    *   are bounded by nProbeSize bytes and nAnalyzeDuration microseconds instead of the FFmpeg
+    *   defaults of 5 MB and 5 seconds, and MP4/MOV and Matroska inputs skip the stream analysis
+    *   when an input with the same codec configuration has been analyzed before in this process
+    *   (see LoadCachedStreamInfo()).
+    */
+    struct OpenOptions {
+        OpenOptions() : bFastOpen(false), nProbeSize(256 * 1024), nAnalyzeDuration(100 * 1000) {}
+        bool bFastOpen;
+        int64_t nProbeSize;
+        int64_t nAnalyzeDuration;
+    };
+
+    /**
+    *   @brief  Movable handle to a demuxed video packet. The payload is backed by the AVPacket
+    *   buffer reference, so it stays valid until the handle is destroyed, independent of
+    *   subsequent demux calls, and can be queued across threads without copying.
+    */
+    class Packet {
+    public:
+        Packet() {}
+        Packet(Packet &&other) : p(other.p) {
+            other.p = NULL;
+        }
+        Packet &operator=(Packet &&other) {
+            if (this != &other) {
+                av_packet_free(&p);
+                p = other.p;
+                other.p = NULL;
+            }
+            return *this;
+        }
+        Packet(const Packet &) = delete;
+        Packet &operator=(const Packet &) = delete;
+        ~Packet() {
+            av_packet_free(&p);
+        }
+        uint8_t *GetData() const {
+            return p ? p->data : NULL;
+        }
+        int GetSize() const {
+            return p ? p->size : 0;
+        }
+        int64_t GetPts() const {
+            return p ? p->pts : AV_NOPTS_VALUE;
+        }
+        int64_t GetDts() const {
+            return p ? p->dts : AV_NOPTS_VALUE;
+        }
+        bool IsKeyFrame() const {
+            return p && (p->flags & AV_PKT_FLAG_KEY);
+        }
+
+    private:
+        friend class FFmpegDemuxer;
+        AVPacket *p = NULL;
+    };
+
+    /**
+    *   @brief  Entry of the packet index sidecar written by WriteIndex(): one per video packet,
+    *   in demux order. Timestamps are in the video stream time base.
+    */
+    struct IndexEntry {
+        int64_t nOffset;
+        int64_t nPts;
+        int64_t nDts;
+        int32_t nSize;
+        uint32_t bKeyFrame;
     };
 
 private:
-    FFmpegDemuxer(AVFormatContext *fmtc) : fmtc(fmtc) {
+    /**
+    *   @brief  Sidecar layout: header, IndexEntry[nEntry], then uint32_t[nKeyFrame] holding the
+    *   entry number of each keyframe.
+    */
+    struct IndexHeader {
+        char szMagic[4];
+        uint32_t uVersion;
+        int64_t nSourceSize;
+        int32_t iStream;
+        int32_t nTimeBaseNum, nTimeBaseDen;
+        uint32_t nEntry, nKeyFrame;
+        uint32_t uReserved[7];
+    };
+
+    std::unique_ptr<MappedFile> pIndexFile;
+    const IndexEntry *pIndexEntry = NULL;
+    const uint32_t *piKeyFrameEntry = NULL;
+    int nIndexEntry = 0, nKeyFrame = 0;
+
+    std::unique_ptr<BoundedQueue<Packet>> pPrefetchQueue;
+    NvThread demuxThread;
+    // Packet returned by the last Demux() call in prefetch mode
+    Packet prefetchedPacket;
+    // Contiguous storage of the last DemuxBatch() call
+    std::vector<uint8_t> vBatch;
+    Packet batchPacket;
+
+    struct StreamQueue {
+        StreamQueue(int nMaxPackets, int nMaxBytes) : queue(nMaxPackets, nMaxBytes) {}
+        std::unique_ptr<AnnexBConverter> pAnnexBConverter;
+        BoundedQueue<Packet> queue;
+        // Packet returned by the last Demux() call on this stream
+        Packet demuxedPacket;
+    };
+    // Per-stream queues in multi-stream mode, in the order of viVideoStream
+    std::vector<std::unique_ptr<StreamQueue>> vpStreamQueue;
+
+    FFmpegDemuxer(AVFormatContext *fmtc, const OpenOptions &options) : fmtc(fmtc) {
         if (!fmtc) {
             LOG(ERROR) << "No AVFormatContext provided.";
             return;
@@ -45,7 +320,12 @@ private:
 
         LOG(INFO) << "Media format: " << fmtc->iformat->long_name << " (" << fmtc->iformat->name << ")";
 
-        ck(avformat_find_stream_info(fmtc, NULL));
+        if (!options.bFastOpen || !LoadCachedStreamInfo(fmtc)) {
+            ck(avformat_find_stream_info(fmtc, NULL));
+            if (options.bFastOpen) {
+                SaveCachedStreamInfo(fmtc);
+            }
+        }
         iVideoStream = av_find_best_stream(fmtc, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
         if (iVideoStream < 0) {
             LOG(ERROR) << "FFmpeg error: " << __FILE__ << " " << __LINE__ << " " << "Could not find stream in input file";
@@ -56,55 +336,200 @@ private:
         eVideoCodec = fmtc->streams[iVideoStream]->codecpar->codec_id;
         nWidth = fmtc->streams[iVideoStream]->codecpar->width;
         nHeight = fmtc->streams[iVideoStream]->codecpar->height;
-        nBitDepth = 8;
-        if (fmtc->streams[iVideoStream]->codecpar->format == AV_PIX_FMT_YUV420P10LE)
-            nBitDepth = 10;
-        if (fmtc->streams[iVideoStream]->codecpar->format == AV_PIX_FMT_YUV420P12LE)
-            nBitDepth = 12;
-
-        bMp4H264 = eVideoCodec == AV_CODEC_ID_H264 && (
-                !strcmp(fmtc->iformat->long_name, "QuickTime / MOV") 
-                || !strcmp(fmtc->iformat->long_name, "FLV (Flash Video)") 
-                || !strcmp(fmtc->iformat->long_name, "Matroska / WebM")
-            );
+        nBitDepth = GetPixelBitDepth(fmtc->streams[iVideoStream]->codecpar);
+
+        for (unsigned i = 0; i < fmtc->nb_streams; i++) {
+            if (fmtc->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && !(fmtc->streams[i]->disposition & AV_DISPOSITION_ATTACHED_PIC)) {
+                viVideoStream.push_back(i);
+            }
+        }
+
+        pAnnexBConverter.reset(AnnexBConverter::Create(fmtc->streams[iVideoStream]->codecpar));
 
         av_init_packet(&pkt);
         pkt.data = NULL;
         pkt.size = 0;
-        av_init_packet(&pktFiltered);
-        pktFiltered.data = NULL;
-        pktFiltered.size = 0;
+    }
 
-        if (bMp4H264) {
-            const AVBitStreamFilter *bsf = av_bsf_get_by_name("h264_mp4toannexb");
-            if (!bsf) {
-                LOG(ERROR) << "FFmpeg error: " << __FILE__ << " " << __LINE__ << " " << "av_bsf_get_by_name() failed";
-                return;
-            }
-            ck(av_bsf_alloc(bsf, &bsfc));
-            bsfc->par_in = fmtc->streams[iVideoStream]->codecpar;
-            ck(av_bsf_init(bsfc));
-        }
+    static int GetPixelBitDepth(const AVCodecParameters *par) {
+        if (par->format == AV_PIX_FMT_YUV420P10LE)
+            return 10;
+        if (par->format == AV_PIX_FMT_YUV420P12LE)
+            return 12;
+        return 8;
     }
 
-    AVFormatContext *CreateFormatContext(DataProvider *pDataProvider) {
-        av_register_all();
+    static void InitFFmpeg() {
+        static std::once_flag flag;
+        std::call_once(flag, []() {
+            av_register_all();
+            avformat_network_init();
+        });
+    }
 
+    static AVFormatContext *AllocFormatContext(const OpenOptions &options) {
         AVFormatContext *ctx = NULL;
         if (!(ctx = avformat_alloc_context())) {
             LOG(ERROR) << "FFmpeg error: " << __FILE__ << " " << __LINE__;
             return NULL;
         }
+        if (options.bFastOpen) {
+            ctx->probesize = std::max(options.nProbeSize, (int64_t)32);
+            ctx->format_probesize = (int)std::min(ctx->probesize, (int64_t)INT_MAX);
+            ctx->max_analyze_duration = std::max(options.nAnalyzeDuration, (int64_t)1);
+        }
+        return ctx;
+    }
+
+    /**
+    *   @brief  Key of the stream info cache: the parameters the container header provides before any
+    *   analysis. Only MP4/MOV and Matroska streams with codec configuration in the header are
+    *   cacheable. Raw streams always go through the analysis, which also sets up their parser.
+    *   Time base and frame rate differ from file to file, so they have to come from the header too.
+    */
+    static bool GetStreamInfoKey(AVFormatContext *fmtc, AVStream *st, std::string *pKey) {
+        const char *szFormat = fmtc->iformat->name;
+        if (strcmp(szFormat, "mov,mp4,m4a,3gp,3g2,mj2") && strcmp(szFormat, "matroska,webm")) {
+            return false;
+        }
+        AVCodecParameters *par = st->codecpar;
+        if (par->codec_id == AV_CODEC_ID_NONE || !par->width || !par->height || !par->extradata_size
+            || st->time_base.num <= 0 || st->time_base.den <= 0
+            || ((st->avg_frame_rate.num <= 0 || st->avg_frame_rate.den <= 0) && (st->r_frame_rate.num <= 0 || st->r_frame_rate.den <= 0))) {
+            return false;
+        }
+        char szPrefix[128];
+        snprintf(szPrefix, sizeof(szPrefix), "%s/%d/%dx%d/", szFormat, (int)par->codec_id, par->width, par->height);
+        *pKey = std::string(szPrefix) + std::string((const char *)par->extradata, par->extradata_size);
+        return true;
+    }
+
+    /**
+    *   @brief  Codec parameters that stream analysis derives from the codec configuration
+    */
+    struct StreamInfo {
+        int format, profile, level, bits_per_raw_sample, video_delay;
+        AVFieldOrder field_order;
+        AVColorRange color_range;
+        AVColorPrimaries color_primaries;
+        AVColorTransferCharacteristic color_trc;
+        AVColorSpace color_space;
+        AVChromaLocation chroma_location;
+        AVRational sample_aspect_ratio;
+    };
+    struct StreamInfoCache {
+        std::mutex mtx;
+        std::map<std::string, StreamInfo> mInfo;
+    };
+    static StreamInfoCache &GetStreamInfoCache() {
+        static StreamInfoCache cache;
+        return cache;
+    }
+
+    template<typename T>
+    static void FillUnset(T &value, T unset, T cached) {
+        if (value == unset) {
+            value = cached;
+        }
+    }
+
+    /**
+    *   @brief  Fills in what stream analysis would have set for every video stream, if all of them
+    *   are in the cache. Values the header already set are kept, as the analysis keeps them.
+    */
+    static bool LoadCachedStreamInfo(AVFormatContext *fmtc) {
+        StreamInfoCache &cache = GetStreamInfoCache();
+        std::vector<std::pair<AVStream *, StreamInfo>> vInfo;
+        {
+            std::lock_guard<std::mutex> lock(cache.mtx);
+            for (unsigned i = 0; i < fmtc->nb_streams; i++) {
+                AVStream *st = fmtc->streams[i];
+                if (st->codecpar->codec_type != AVMEDIA_TYPE_VIDEO || (st->disposition & AV_DISPOSITION_ATTACHED_PIC)) {
+                    continue;
+                }
+                std::string key;
+                std::map<std::string, StreamInfo>::iterator it;
+                if (!GetStreamInfoKey(fmtc, st, &key) || (it = cache.mInfo.find(key)) == cache.mInfo.end()) {
+                    return false;
+                }
+                vInfo.push_back(std::make_pair(st, it->second));
+            }
+        }
+        if (vInfo.empty()) {
+            return false;
+        }
+        for (auto &info : vInfo) {
+            AVStream *st = info.first;
+            AVCodecParameters *par = st->codecpar;
+            const StreamInfo &cached = info.second;
+            FillUnset(par->format, -1, cached.format);
+            FillUnset(par->profile, FF_PROFILE_UNKNOWN, cached.profile);
+            FillUnset(par->level, FF_LEVEL_UNKNOWN, cached.level);
+            FillUnset(par->bits_per_raw_sample, 0, cached.bits_per_raw_sample);
+            FillUnset(par->video_delay, 0, cached.video_delay);
+            FillUnset(par->field_order, AV_FIELD_UNKNOWN, cached.field_order);
+            FillUnset(par->color_range, AVCOL_RANGE_UNSPECIFIED, cached.color_range);
+            FillUnset(par->color_primaries, AVCOL_PRI_UNSPECIFIED, cached.color_primaries);
+            FillUnset(par->color_trc, AVCOL_TRC_UNSPECIFIED, cached.color_trc);
+            FillUnset(par->color_space, AVCOL_SPC_UNSPECIFIED, cached.color_space);
+            FillUnset(par->chroma_location, AVCHROMA_LOC_UNSPECIFIED, cached.chroma_location);
+            if (!par->sample_aspect_ratio.num) {
+                par->sample_aspect_ratio = cached.sample_aspect_ratio;
+            }
+            if (!st->sample_aspect_ratio.num) {
+                st->sample_aspect_ratio = par->sample_aspect_ratio;
+            }
+            // The analysis fills in whichever frame rate the header left out
+            if (st->avg_frame_rate.num <= 0 || st->avg_frame_rate.den <= 0) {
+                st->avg_frame_rate = st->r_frame_rate;
+            }
+            if (st->r_frame_rate.num <= 0 || st->r_frame_rate.den <= 0) {
+                st->r_frame_rate = st->avg_frame_rate;
+            }
+        }
+        return true;
+    }
+
+    static void SaveCachedStreamInfo(AVFormatContext *fmtc) {
+        // Distinct configurations are few in practice; the bound only guards against unbounded growth
+        const size_t nMaxEntries = 256;
+        StreamInfoCache &cache = GetStreamInfoCache();
+        std::lock_guard<std::mutex> lock(cache.mtx);
+        for (unsigned i = 0; i < fmtc->nb_streams; i++) {
+            AVStream *st = fmtc->streams[i];
+            AVCodecParameters *par = st->codecpar;
+            std::string key;
+            if (par->codec_type != AVMEDIA_TYPE_VIDEO || par->format < 0 || !GetStreamInfoKey(fmtc, st, &key)) {
+                continue;
+            }
+            if (cache.mInfo.size() >= nMaxEntries) {
+                cache.mInfo.clear();
+            }
+            StreamInfo info = {par->format, par->profile, par->level, par->bits_per_raw_sample, par->video_delay,
+                par->field_order, par->color_range, par->color_primaries, par->color_trc, par->color_space,
+                par->chroma_location, par->sample_aspect_ratio};
+            cache.mInfo[key] = info;
+        }
+    }
+
+    AVFormatContext *CreateFormatContext(DataProvider *pDataProvider, int nAvioBufferSize, const OpenOptions &options) {
+        InitFFmpeg();
+
+        AVFormatContext *ctx = AllocFormatContext(options);
+        if (!ctx) {
+            return NULL;
+        }
 
         uint8_t *avioc_buffer = NULL;
-        int avioc_buffer_size = 8 * 1024 * 1024;
+        int avioc_buffer_size = nAvioBufferSize;
         avioc_buffer = (uint8_t *)av_malloc(avioc_buffer_size);
         if (!avioc_buffer) {
             LOG(ERROR) << "FFmpeg error: " << __FILE__ << " " << __LINE__;
             return NULL;
         }
+        bool bSeekable = pDataProvider->Seek(0, SEEK_CUR) >= 0;
         avioc = avio_alloc_context(avioc_buffer, avioc_buffer_size,
-            0, pDataProvider, &ReadPacket, NULL, NULL);
+            0, pDataProvider, &ReadPacket, NULL, bSeekable ? &SeekPacket : NULL);
         if (!avioc) {
             LOG(ERROR) << "FFmpeg error: " << __FILE__ << " " << __LINE__;
             return NULL;
@@ -115,25 +540,37 @@ private:
         return ctx;
     }
 
-    AVFormatContext *CreateFormatContext(const char *szFilePath) {
-        av_register_all();
-        avformat_network_init();
+    AVFormatContext *CreateFormatContext(const char *szFilePath, const OpenOptions &options) {
+        InitFFmpeg();
 
-        AVFormatContext *ctx = NULL;
+        AVFormatContext *ctx = AllocFormatContext(options);
+        if (!ctx) {
+            return NULL;
+        }
         ck(avformat_open_input(&ctx, szFilePath, NULL, NULL));
         return ctx;
     }
 
 public:
-    FFmpegDemuxer(const char *szFilePath) : FFmpegDemuxer(CreateFormatContext(szFilePath)) {}
-    FFmpegDemuxer(DataProvider *pDataProvider) : FFmpegDemuxer(CreateFormatContext(pDataProvider)) {}
+    FFmpegDemuxer(const char *szFilePath, const OpenOptions &options = OpenOptions()) : FFmpegDemuxer(CreateFormatContext(szFilePath, options), options) {}
+    /**
+    *   @brief  Demuxes from a DataProvider. Reads go through an AVIO buffer of nAvioBufferSize
+    *   bytes; providers that serve from memory can use a much smaller buffer than the default.
+    */
+    FFmpegDemuxer(DataProvider *pDataProvider, int nAvioBufferSize = 8 * 1024 * 1024, const OpenOptions &options = OpenOptions())
+        : FFmpegDemuxer(CreateFormatContext(pDataProvider, nAvioBufferSize, options), options) {}
     ~FFmpegDemuxer() {
+        if (pPrefetchQueue) {
+            pPrefetchQueue->Close();
+        }
+        for (auto &pStreamQueue : vpStreamQueue) {
+            pStreamQueue->queue.Close();
+        }
+        demuxThread.join();
+
         if (pkt.data) {
             av_packet_unref(&pkt);
         }
-        if (pktFiltered.data) {
-            av_packet_unref(&pktFiltered);
-        }
 
         avformat_close_input(&fmtc);
         if (avioc) {
@@ -156,6 +593,243 @@ public:
     int GetFrameSize() {
         return nBitDepth == 8 ? nWidth * nHeight * 3 / 2: nWidth * nHeight * 3;
     }
+    /**
+    *   @brief  Frame rate of the video stream as a fraction. Returns false if the container
+    *   doesn't tell.
+    */
+    bool GetFrameRate(int *pnNum, int *pnDen) {
+        if (!fmtc || iVideoStream < 0) {
+            return false;
+        }
+        AVRational rate = fmtc->streams[iVideoStream]->avg_frame_rate;
+        if (rate.num <= 0 || rate.den <= 0) {
+            rate = fmtc->streams[iVideoStream]->r_frame_rate;
+        }
+        if (rate.num <= 0 || rate.den <= 0) {
+            return false;
+        }
+        *pnNum = rate.num;
+        *pnDen = rate.den;
+        return true;
+    }
+    /**
+    *   @brief  Scans the whole input once and writes the offset, timestamps, size and keyframe
+    *   flag of every video packet to a sidecar file at szIndexPath. The index is loaded
+    *   afterwards and the demuxer is rewound to the first keyframe.
+    */
+    bool WriteIndex(const char *szIndexPath) {
+        if (!fmtc || IsDemuxThreadStarted()) {
+            return false;
+        }
+
+        std::vector<IndexEntry> vEntry;
+        std::vector<uint32_t> viKeyFrameEntry;
+        AVPacket pktRead;
+        av_init_packet(&pktRead);
+        pktRead.data = NULL;
+        pktRead.size = 0;
+        while (av_read_frame(fmtc, &pktRead) >= 0) {
+            if (pktRead.stream_index == iVideoStream) {
+                bool bKeyFrame = (pktRead.flags & AV_PKT_FLAG_KEY) != 0;
+                if (bKeyFrame) {
+                    viKeyFrameEntry.push_back((uint32_t)vEntry.size());
+                }
+                IndexEntry entry = {pktRead.pos, pktRead.pts, pktRead.dts, pktRead.size, bKeyFrame};
+                vEntry.push_back(entry);
+            }
+            av_packet_unref(&pktRead);
+        }
+
+        IndexHeader header = {};
+        memcpy(header.szMagic, "NVDI", 4);
+        header.uVersion = 1;
+        header.nSourceSize = avio_size(fmtc->pb);
+        header.iStream = iVideoStream;
+        header.nTimeBaseNum = fmtc->streams[iVideoStream]->time_base.num;
+        header.nTimeBaseDen = fmtc->streams[iVideoStream]->time_base.den;
+        header.nEntry = (uint32_t)vEntry.size();
+        header.nKeyFrame = (uint32_t)viKeyFrameEntry.size();
+
+        std::ofstream fpIndex(szIndexPath, std::ios::out | std::ios::binary);
+        if (!fpIndex) {
+            LOG(ERROR) << "Unable to open index file: " << szIndexPath;
+            return false;
+        }
+        fpIndex.write(reinterpret_cast<char *>(&header), sizeof(header));
+        fpIndex.write(reinterpret_cast<char *>(vEntry.data()), vEntry.size() * sizeof(IndexEntry));
+        fpIndex.write(reinterpret_cast<char *>(viKeyFrameEntry.data()), viKeyFrameEntry.size() * sizeof(uint32_t));
+        fpIndex.close();
+        if (!fpIndex) {
+            LOG(ERROR) << "Failed to write index file: " << szIndexPath;
+            return false;
+        }
+
+        return LoadIndex(szIndexPath) && (!nKeyFrame || SeekToKeyFrame(0));
+    }
+    /**
+    *   @brief  Maps an index sidecar written by WriteIndex() for the same input. Fails if the
+    *   sidecar does not match the input.
+    */
+    bool LoadIndex(const char *szIndexPath) {
+        if (!fmtc) {
+            return false;
+        }
+
+        std::unique_ptr<MappedFile> pFile(new MappedFile(szIndexPath));
+        const IndexHeader *pHeader = (const IndexHeader *)pFile->GetData();
+        if (!pHeader || pFile->GetSize() < sizeof(IndexHeader) || memcmp(pHeader->szMagic, "NVDI", 4) || pHeader->uVersion != 1
+            || pFile->GetSize() != sizeof(IndexHeader) + (uint64_t)pHeader->nEntry * sizeof(IndexEntry) + (uint64_t)pHeader->nKeyFrame * sizeof(uint32_t)) {
+            LOG(ERROR) << "Invalid index file: " << szIndexPath;
+            return false;
+        }
+        if (pHeader->iStream != iVideoStream || pHeader->nSourceSize != avio_size(fmtc->pb)) {
+            LOG(ERROR) << "Index file " << szIndexPath << " does not match the input";
+            return false;
+        }
+
+        pIndexFile = std::move(pFile);
+        pIndexEntry = (const IndexEntry *)(pIndexFile->GetData() + sizeof(IndexHeader));
+        piKeyFrameEntry = (const uint32_t *)(pIndexEntry + pHeader->nEntry);
+        nIndexEntry = pHeader->nEntry;
+        nKeyFrame = pHeader->nKeyFrame;
+        return true;
+    }
+    int GetIndexEntryCount() {
+        return nIndexEntry;
+    }
+    const IndexEntry *GetIndexEntry(int iEntry) {
+        return iEntry >= 0 && iEntry < nIndexEntry ? pIndexEntry + iEntry : NULL;
+    }
+    int GetKeyFrameCount() {
+        return nKeyFrame;
+    }
+    const IndexEntry *GetKeyFrame(int iKeyFrame) {
+        return iKeyFrame >= 0 && iKeyFrame < nKeyFrame ? pIndexEntry + piKeyFrameEntry[iKeyFrame] : NULL;
+    }
+    /**
+    *   @brief  Returns the last keyframe whose pts is not after nPts (0 if there is none), or -1
+    *   if no index is loaded.
+    */
+    int FindKeyFrame(int64_t nPts) {
+        if (!nKeyFrame) {
+            return -1;
+        }
+        int l = 0, r = nKeyFrame;
+        while (r - l > 1) {
+            int m = (l + r) / 2;
+            if (pIndexEntry[piKeyFrameEntry[m]].nPts <= nPts) {
+                l = m;
+            } else {
+                r = m;
+            }
+        }
+        return l;
+    }
+    /**
+    *   @brief  Repositions the demuxer so that the next packet is the given keyframe. The index
+    *   gives the location directly, so libavformat does not have to search the container.
+    */
+    bool SeekToKeyFrame(int iKeyFrame) {
+        const IndexEntry *pEntry = GetKeyFrame(iKeyFrame);
+        if (!pEntry || IsDemuxThreadStarted()) {
+            LOG(ERROR) << "Cannot seek to keyframe " << iKeyFrame;
+            return false;
+        }
+
+        if (pkt.data) {
+            av_packet_unref(&pkt);
+        }
+
+        const int flags = fmtc->iformat->flags;
+        const bool bByteSeek = pEntry->nOffset >= 0 && !(flags & AVFMT_NO_BYTE_SEEK);
+        // Formats with an index or timestamps of their own (MP4, MKV, TS) seek by timestamp. Those
+        // that would build a generic index by scanning the input go to the byte offset directly,
+        // as does any format whose timestamp seek fails.
+        if (!bByteSeek || !(flags & AVFMT_GENERIC_INDEX)) {
+            int64_t nTs = (flags & AVFMT_SEEK_TO_PTS) || pEntry->nDts == AV_NOPTS_VALUE ? pEntry->nPts : pEntry->nDts;
+            int e = av_seek_frame(fmtc, iVideoStream, nTs, AVSEEK_FLAG_BACKWARD);
+            if (e >= 0 || !bByteSeek) {
+                return ck(e);
+            }
+        }
+        return ck(av_seek_frame(fmtc, iVideoStream, pEntry->nOffset, AVSEEK_FLAG_BYTE));
+    }
+    /**
+    *   @brief  Starts a read-ahead thread that demuxes (and converts) video packets into a queue
+    *   bounded by nMaxPackets packets and nMaxBytes payload bytes, so that storage stalls do not
+    *   stall the caller. Demux() and DemuxPacket() consume from the queue afterwards.
+    */
+    void StartPrefetch(int nMaxPackets = 64, int nMaxBytes = 64 * 1024 * 1024) {
+        if (!fmtc || IsDemuxThreadStarted()) {
+            return;
+        }
+
+        pPrefetchQueue.reset(new BoundedQueue<Packet>(nMaxPackets, nMaxBytes));
+        demuxThread = NvThread(std::thread(&FFmpegDemuxer::PrefetchProc, this));
+    }
+    /**
+    *   @brief  Returns the number of video streams in the input. Streams are addressed by their
+    *   ordinal in [0, GetVideoStreamCount()) in the multi-stream functions below.
+    */
+    int GetVideoStreamCount() {
+        return (int)viVideoStream.size();
+    }
+    AVCodecID GetVideoCodec(int iStream) {
+        return fmtc->streams[viVideoStream[iStream]]->codecpar->codec_id;
+    }
+    int GetWidth(int iStream) {
+        return fmtc->streams[viVideoStream[iStream]]->codecpar->width;
+    }
+    int GetHeight(int iStream) {
+        return fmtc->streams[viVideoStream[iStream]]->codecpar->height;
+    }
+    int GetBitDepth(int iStream) {
+        return GetPixelBitDepth(fmtc->streams[viVideoStream[iStream]]->codecpar);
+    }
+    /**
+    *   @brief  Starts single-pass demuxing of all video streams: one background thread reads
+    *   the input once and routes the packets of each stream to its own queue, bounded by
+    *   nMaxPackets packets and nMaxBytes bytes. Consume each stream with Demux(..., iStream) or
+    *   DemuxPacket(..., iStream), typically from one thread per stream. Every stream has to be
+    *   consumed; the reader waits while any queue is full.
+    */
+    bool StartMultiStream(int nMaxPackets = 64, int nMaxBytes = 64 * 1024 * 1024) {
+        if (!fmtc || IsDemuxThreadStarted() || viVideoStream.empty()) {
+            return false;
+        }
+
+        for (int iStream : viVideoStream) {
+            std::unique_ptr<StreamQueue> pStreamQueue(new StreamQueue(nMaxPackets, nMaxBytes));
+            pStreamQueue->pAnnexBConverter.reset(AnnexBConverter::Create(fmtc->streams[iStream]->codecpar));
+            vpStreamQueue.push_back(std::move(pStreamQueue));
+        }
+        demuxThread = NvThread(std::thread(&FFmpegDemuxer::MultiStreamProc, this));
+        return true;
+    }
+    bool Demux(uint8_t **ppVideo, int *pnVideoBytes, int iStream) {
+        *pnVideoBytes = 0;
+
+        if (iStream < 0 || iStream >= (int)vpStreamQueue.size()) {
+            LOG(ERROR) << "Stream " << iStream << " is not being demuxed";
+            return false;
+        }
+
+        StreamQueue *pStreamQueue = vpStreamQueue[iStream].get();
+        if (!pStreamQueue->queue.Pop(&pStreamQueue->demuxedPacket)) {
+            return false;
+        }
+        *ppVideo = pStreamQueue->demuxedPacket.GetData();
+        *pnVideoBytes = pStreamQueue->demuxedPacket.GetSize();
+        return true;
+    }
+    bool DemuxPacket(Packet *pPacket, int iStream) {
+        if (iStream < 0 || iStream >= (int)vpStreamQueue.size()) {
+            LOG(ERROR) << "Stream " << iStream << " is not being demuxed";
+            return false;
+        }
+
+        return vpStreamQueue[iStream]->queue.Pop(pPacket);
+    }
     bool Demux(uint8_t **ppVideo, int *pnVideoBytes) {
         if (!fmtc) {
             return false;
@@ -163,37 +837,198 @@ public:
 
         *pnVideoBytes = 0;
 
+        if (!vpStreamQueue.empty()) {
+            return Demux(ppVideo, pnVideoBytes, GetBestStreamOrdinal());
+        }
+
+        if (pPrefetchQueue) {
+            if (!pPrefetchQueue->Pop(&prefetchedPacket)) {
+                return false;
+            }
+            *ppVideo = prefetchedPacket.GetData();
+            *pnVideoBytes = prefetchedPacket.GetSize();
+            return true;
+        }
+
         if (pkt.data) {
             av_packet_unref(&pkt);
         }
 
-        int e = 0;
-        while ((e = av_read_frame(fmtc, &pkt)) >= 0 && pkt.stream_index != iVideoStream) {
-            av_packet_unref(&pkt);
+        if (!ReadVideoPacket(&pkt)) {
+            return false;
         }
-        if (e < 0) {
+
+        *ppVideo = pkt.data;
+        *pnVideoBytes = pkt.size;
+
+        return true;
+    }
+    /**
+    *   @brief  Demuxes the next video packet into a refcounted handle. Unlike Demux(), the
+    *   returned payload is not invalidated by the next call.
+    */
+    bool DemuxPacket(Packet *pPacket) {
+        if (!fmtc) {
             return false;
         }
 
-        if (bMp4H264) {
-            if (pktFiltered.data) {
-                av_packet_unref(&pktFiltered);
+        if (!vpStreamQueue.empty()) {
+            return DemuxPacket(pPacket, GetBestStreamOrdinal());
+        }
+
+        if (pPrefetchQueue) {
+            return pPrefetchQueue->Pop(pPacket);
+        }
+
+        return ReadVideoPacket(pPacket);
+    }
+    /**
+    *   @brief  Demuxes up to nMaxPackets video packets into the caller-owned array aPacket in one
+    *   call, stopping once they add up to nMaxBytes. The packet crossing the byte limit is kept, so
+    *   a batch is only empty at the end of the stream. Returns the number of packets.
+    */
+    int DemuxBatch(Packet *aPacket, int nMaxPackets, int nMaxBytes = INT_MAX) {
+        int nPacket = 0, nBytes = 0;
+        while (nPacket < nMaxPackets && nBytes < nMaxBytes && DemuxPacket(&aPacket[nPacket])) {
+            nBytes += aPacket[nPacket++].GetSize();
+        }
+        return nPacket;
+    }
+    /**
+    *   @brief  Same as above, but the packets are stored back to back in one buffer owned by the
+    *   demuxer and valid until the next call; anPacketBytes (optional, nMaxPackets entries) receives
+    *   the size of each packet. For H.264/HEVC the buffer is an Annex-B stream that can be passed
+    *   to NvDecoder::Decode() in a single call when per-packet timestamps are not needed.
+    */
+    int DemuxBatch(uint8_t **ppVideo, int *pnVideoBytes, int *anPacketBytes, int nMaxPackets, int nMaxBytes = INT_MAX) {
+        vBatch.clear();
+        int nPacket = 0;
+        while (nPacket < nMaxPackets && (int)vBatch.size() < nMaxBytes && DemuxPacket(&batchPacket)) {
+            vBatch.insert(vBatch.end(), batchPacket.GetData(), batchPacket.GetData() + batchPacket.GetSize());
+            if (anPacketBytes) {
+                anPacketBytes[nPacket] = batchPacket.GetSize();
+            }
+            nPacket++;
+        }
+        *ppVideo = vBatch.data();
+        *pnVideoBytes = (int)vBatch.size();
+        return nPacket;
+    }
+
+private:
+    bool ReadVideoPacket(AVPacket *pPkt) {
+        while (true) {
+            int e = 0;
+            while ((e = av_read_frame(fmtc, pPkt)) >= 0 && pPkt->stream_index != iVideoStream) {
+                av_packet_unref(pPkt);
+            }
+            if (e < 0) {
+                return false;
             }
-            ck(av_bsf_send_packet(bsfc, &pkt));
-            ck(av_bsf_receive_packet(bsfc, &pktFiltered));
-            *ppVideo = pktFiltered.data;
-            *pnVideoBytes = pktFiltered.size;
+            if (!pAnnexBConverter || pAnnexBConverter->Convert(pPkt)) {
+                return true;
+            }
+            // NVDEC would get a packet that is not a valid Annex-B stream; skip to the next one
+            LOG(WARNING) << "Dropping video packet at pts " << pPkt->pts;
+            av_packet_unref(pPkt);
+        }
+    }
+
+    bool ReadVideoPacket(Packet *pPacket) {
+        AVPacket pktRead;
+        av_init_packet(&pktRead);
+        pktRead.data = NULL;
+        pktRead.size = 0;
+        if (!ReadVideoPacket(&pktRead)) {
+            return false;
+        }
+
+        if (!pPacket->p) {
+            pPacket->p = av_packet_alloc();
+        } else {
+            av_packet_unref(pPacket->p);
+        }
+        if (pktRead.buf) {
+            av_packet_move_ref(pPacket->p, &pktRead);
         } else {
-            *ppVideo = pkt.data;
-            *pnVideoBytes = pkt.size;
+            // Demuxer-owned payload: take a private copy so the handle outlives the next read
+            ck(av_packet_ref(pPacket->p, &pktRead));
+            av_packet_unref(&pktRead);
         }
 
         return true;
     }
 
+    void PrefetchProc() {
+        Packet packet;
+        while (ReadVideoPacket(&packet)) {
+            int nSize = packet.GetSize();
+            if (!pPrefetchQueue->Push(std::move(packet), nSize)) {
+                break;
+            }
+        }
+        pPrefetchQueue->Close();
+    }
+
+    void MultiStreamProc() {
+        std::vector<int> viOrdinal(fmtc->nb_streams, -1);
+        for (int i = 0; i < (int)viVideoStream.size(); i++) {
+            viOrdinal[viVideoStream[i]] = i;
+        }
+
+        Packet packet;
+        packet.p = av_packet_alloc();
+        while (av_read_frame(fmtc, packet.p) >= 0) {
+            int iOrdinal = packet.p->stream_index < (int)viOrdinal.size() ? viOrdinal[packet.p->stream_index] : -1;
+            if (iOrdinal < 0) {
+                av_packet_unref(packet.p);
+                continue;
+            }
+
+            StreamQueue *pStreamQueue = vpStreamQueue[iOrdinal].get();
+            if (pStreamQueue->pAnnexBConverter && !pStreamQueue->pAnnexBConverter->Convert(packet.p)) {
+                LOG(WARNING) << "Dropping packet of video stream " << iOrdinal << " at pts " << packet.p->pts;
+                av_packet_unref(packet.p);
+                continue;
+            }
+            if (!packet.p->buf) {
+                AVPacket pktRead;
+                av_packet_move_ref(&pktRead, packet.p);
+                ck(av_packet_ref(packet.p, &pktRead));
+                av_packet_unref(&pktRead);
+            }
+
+            int nSize = packet.GetSize();
+            if (!pStreamQueue->queue.Push(std::move(packet), nSize)) {
+                break;
+            }
+            packet.p = av_packet_alloc();
+        }
+
+        for (auto &pStreamQueue : vpStreamQueue) {
+            pStreamQueue->queue.Close();
+        }
+    }
+
+    int GetBestStreamOrdinal() {
+        return (int)(std::find(viVideoStream.begin(), viVideoStream.end(), iVideoStream) - viVideoStream.begin());
+    }
+
+    bool IsDemuxThreadStarted() {
+        return pPrefetchQueue || !vpStreamQueue.empty();
+    }
+
+public:
     static int ReadPacket(void *opaque, uint8_t *pBuf, int nBuf) {
         return ((DataProvider *)opaque)->GetData(pBuf, nBuf);
     }
+
+    static int64_t SeekPacket(void *opaque, int64_t nOffset, int iWhence) {
+        if (iWhence & AVSEEK_SIZE) {
+            return ((DataProvider *)opaque)->GetSize();
+        }
+        return ((DataProvider *)opaque)->Seek(nOffset, iWhence & ~AVSEEK_FORCE);
+    }
 };
 
 inline cudaVideoCodec FFmpeg2NvCodecId(AVCodecID id) {
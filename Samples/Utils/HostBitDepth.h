@@ -0,0 +1,217 @@
+/*
+* Copyright 2017-2018 NVIDIA Corporation.  All rights reserved.
+*
+* Please refer to the NVIDIA end user license agreement (EULA) associated
+* with this source code for terms and conditions that govern your use of
+* this software. Any use, reproduction, disclosure, or distribution of
+* this software and related documentation outside the terms of the EULA
+* is strictly prohibited.
+*
+*/
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "NvCodecUtils.h"
+
+/**
+* @brief Host versions of the conversions in BitDepth.cu, plus frame-level helpers that reduce
+* P016/P010 and YUV420P16 to 8 bits with optional dithering. Plain reduction keeps the high byte
+* like the CUDA kernel; dithering spreads the dropped bits so that 10-bit gradients don't band.
+* Pitches are in bytes.
+*/
+typedef enum DitherMode {
+    DitherMode_None = 0,
+    // 8x8 Bayer threshold added before truncation; parallel and stable over time
+    DitherMode_Ordered = 1,
+    // Floyd-Steinberg in bands of rows that run in parallel; lowest banding, slower than ordered
+    DitherMode_ErrorDiffusion = 2
+} DitherMode;
+
+/**
+* @brief Thresholds in 1/256 of an output step, for row y; entry i is for sample i of the row
+*/
+inline const uint16_t *GetBayerRow(int y) {
+    static const uint16_t aaThreshold[8][8] = {
+        {  2, 130,  34, 162,  10, 138,  42, 170},
+        {194,  66, 226,  98, 202,  74, 234, 106},
+        { 50, 178,  18, 146,  58, 186,  26, 154},
+        {242, 114, 210,  82, 250, 122, 218,  90},
+        { 14, 142,  46, 174,   6, 134,  38, 166},
+        {206,  78, 238, 110, 198,  70, 230, 102},
+        { 62, 190,  30, 158,  54, 182,  22, 150},
+        {254, 126, 222,  94, 246, 118, 214,  86},
+    };
+    return aaThreshold[y & 7];
+}
+
+/**
+* @brief Reduces samples [x, nWidth) of a row to their high byte after adding the threshold of
+* the sample's pixel; samples of a pixel are nChannel apart.
+*/
+inline void ConvertRowUInt16ToUInt8(const uint16_t *pSrc, uint8_t *pDst, int x, int nWidth, int nChannel, const uint16_t *pThreshold) {
+    for (; x < nWidth; x++) {
+        int v = pSrc[x] + (pThreshold ? pThreshold[(x / nChannel) & 7] : 0);
+        pDst[x] = (uint8_t)((v > 0xFFFF ? 0xFFFF : v) >> 8);
+    }
+}
+
+inline void ConvertRowUInt8ToUInt16(const uint8_t *pSrc, uint16_t *pDst, int x, int nWidth) {
+    for (; x < nWidth; x++) {
+        pDst[x] = (uint16_t)(pSrc[x] << 8);
+    }
+}
+
+#ifdef HOST_AVX2
+HOST_AVX2_TARGET inline int ConvertRowUInt16ToUInt8Avx2(const uint16_t *pSrc, uint8_t *pDst, int nWidth, int nChannel, const uint16_t *pThreshold) {
+    // 16 samples cover the pattern once with nChannel 2, twice with nChannel 1
+    uint16_t aThreshold[16] = {};
+    if (pThreshold) {
+        for (int i = 0; i < 16; i++) {
+            aThreshold[i] = pThreshold[(i / nChannel) & 7];
+        }
+    }
+    const __m256i t = _mm256_loadu_si256((const __m256i *)aThreshold);
+    int x = 0;
+    for (; x + 16 <= nWidth; x += 16) {
+        __m256i v = _mm256_srli_epi16(_mm256_adds_epu16(_mm256_loadu_si256((const __m256i *)(pSrc + x)), t), 8);
+        v = _mm256_permute4x64_epi64(_mm256_packus_epi16(v, v), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm_storeu_si128((__m128i *)(pDst + x), _mm256_castsi256_si128(v));
+    }
+    return x;
+}
+
+HOST_AVX2_TARGET inline int ConvertRowUInt8ToUInt16Avx2(const uint8_t *pSrc, uint16_t *pDst, int nWidth) {
+    int x = 0;
+    for (; x + 16 <= nWidth; x += 16) {
+        __m256i v = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i *)(pSrc + x)));
+        _mm256_storeu_si256((__m256i *)(pDst + x), _mm256_slli_epi16(v, 8));
+    }
+    return x;
+}
+#endif
+
+/**
+* @brief Floyd-Steinberg reduction of rows [iBegin, iEnd) of a plane; samples of a pixel are
+* nChannel apart and diffuse their error separately. Bands are independent: the error is seeded
+* with the error ordered dithering leaves nWarmUp rows above the band, and diffused over those
+* rows without output, so that the band boundaries don't show.
+*/
+inline void ErrorDiffuseRowsUInt16ToUInt8(const uint8_t *pSrc, int nSrcPitch, uint8_t *pDst, int nDstPitch, int nWidth, int iBegin, int iEnd, int nChannel,
+    int nWarmUp = 16) {
+    // Errors, in 1/16 units, for the current and the next row, with one pixel of margin on each side
+    std::vector<int> vErr(2 * (size_t)(nWidth + 2 * nChannel));
+    int *pErr = vErr.data() + nChannel, *pNextErr = pErr + nWidth + 2 * nChannel;
+    std::vector<uint8_t> vWarmUpRow;
+    const int iStart = (std::max)(iBegin - nWarmUp, 0);
+    if (iStart < iBegin) {
+        vWarmUpRow.resize(nWidth);
+    }
+    if (iStart > 0) {
+        const uint16_t *pSrcRow = (const uint16_t *)(pSrc + (size_t)(iStart - 1) * nSrcPitch), *pThreshold = GetBayerRow(iStart - 1);
+        for (int x = 0; x < nWidth; x++) {
+            int q = (pSrcRow[x] + pThreshold[(x / nChannel) & 7]) >> 8;
+            int e = pSrcRow[x] - ((q > 255 ? 255 : q) << 8);
+            pErr[x - nChannel] += 3 * e;
+            pErr[x] += 5 * e;
+            pErr[x + nChannel] += e;
+        }
+    }
+    for (int y = iStart; y < iEnd; y++) {
+        const uint16_t *pSrcRow = (const uint16_t *)(pSrc + (size_t)y * nSrcPitch);
+        uint8_t *pDstRow = y < iBegin ? vWarmUpRow.data() : pDst + (size_t)y * nDstPitch;
+        for (int x = 0; x < nWidth; x++) {
+            int v = pSrcRow[x] + ((pErr[x] + 8) >> 4);
+            int q = (v + 128) >> 8;
+            q = q < 0 ? 0 : (q > 255 ? 255 : q);
+            pDstRow[x] = (uint8_t)q;
+            int e = v - (q << 8);
+            pErr[x + nChannel] += 7 * e;
+            pNextErr[x - nChannel] += 3 * e;
+            pNextErr[x] += 5 * e;
+            pNextErr[x + nChannel] += e;
+        }
+        std::swap(pErr, pNextErr);
+        std::fill(pNextErr - nChannel, pNextErr + nWidth + nChannel, 0);
+    }
+}
+
+/**
+* @brief Floyd-Steinberg reduction of a whole plane, in parallel bands of rows
+*/
+inline void ErrorDiffusePlaneUInt16ToUInt8(const uint8_t *pSrc, int nSrcPitch, uint8_t *pDst, int nDstPitch, int nWidth, int nHeight, int nChannel) {
+    // The band height is fixed, so the result doesn't depend on the number of threads
+    const int nBandHeight = 64;
+    ParallelFor((nHeight + nBandHeight - 1) / nBandHeight, [&](int iBegin, int iEnd) {
+        for (int i = iBegin; i < iEnd; i++) {
+            ErrorDiffuseRowsUInt16ToUInt8(pSrc, nSrcPitch, pDst, nDstPitch, nWidth, i * nBandHeight, (std::min)((i + 1) * nBandHeight, nHeight), nChannel);
+        }
+    }, 1);
+}
+
+/**
+* @brief Reduces a plane of nWidth 16-bit samples per row, nChannel samples per pixel
+*/
+inline void ConvertPlaneUInt16ToUInt8Host(const uint8_t *pSrc, int nSrcPitch, uint8_t *pDst, int nDstPitch, int nWidth, int nHeight, int nChannel, DitherMode eDither) {
+    if (eDither == DitherMode_ErrorDiffusion) {
+        ErrorDiffusePlaneUInt16ToUInt8(pSrc, nSrcPitch, pDst, nDstPitch, nWidth, nHeight, nChannel);
+        return;
+    }
+    ParallelFor(nHeight, [&](int iBegin, int iEnd) {
+        for (int y = iBegin; y < iEnd; y++) {
+            const uint16_t *pSrcRow = (const uint16_t *)(pSrc + (size_t)y * nSrcPitch), *pThreshold = eDither == DitherMode_Ordered ? GetBayerRow(y) : NULL;
+            uint8_t *pDstRow = pDst + (size_t)y * nDstPitch;
+            int x = 0;
+#ifdef HOST_AVX2
+            if (IsAvx2Supported()) {
+                x = ConvertRowUInt16ToUInt8Avx2(pSrcRow, pDstRow, nWidth, nChannel, pThreshold);
+            }
+#endif
+            ConvertRowUInt16ToUInt8(pSrcRow, pDstRow, x, nWidth, nChannel, pThreshold);
+        }
+    }, 16, GetRowBandAlignment(nDstPitch));
+}
+
+inline void ConvertUInt8ToUInt16Host(uint8_t *pUInt8, uint16_t *pUInt16, int nSrcPitch, int nDestPitch, int nWidth, int nHeight) {
+    ParallelFor(nHeight, [&](int iBegin, int iEnd) {
+        for (int y = iBegin; y < iEnd; y++) {
+            const uint8_t *pSrcRow = pUInt8 + (size_t)y * nSrcPitch;
+            uint16_t *pDstRow = (uint16_t *)((uint8_t *)pUInt16 + (size_t)y * nDestPitch);
+            int x = 0;
+#ifdef HOST_AVX2
+            if (IsAvx2Supported()) {
+                x = ConvertRowUInt8ToUInt16Avx2(pSrcRow, pDstRow, nWidth);
+            }
+#endif
+            ConvertRowUInt8ToUInt16(pSrcRow, pDstRow, x, nWidth);
+        }
+    }, 16, GetRowBandAlignment(nDestPitch));
+}
+
+inline void ConvertUInt16ToUInt8Host(uint16_t *pUInt16, uint8_t *pUInt8, int nSrcPitch, int nDestPitch, int nWidth, int nHeight, DitherMode eDither = DitherMode_None) {
+    ConvertPlaneUInt16ToUInt8Host((const uint8_t *)pUInt16, nSrcPitch, pUInt8, nDestPitch, nWidth, nHeight, 1, eDither);
+}
+
+/**
+* @brief P016 (or P010) to NV12; the chroma pairs are dithered as pixels
+*/
+inline void P016ToNv12Host(uint8_t *pP016, int nP016Pitch, uint8_t *pNv12, int nNv12Pitch, int nWidth, int nHeight, DitherMode eDither = DitherMode_None) {
+    // Each plane is split into bands of rows, so the planes can go one after the other
+    ConvertPlaneUInt16ToUInt8Host(pP016, nP016Pitch, pNv12, nNv12Pitch, nWidth, nHeight, 1, eDither);
+    ConvertPlaneUInt16ToUInt8Host(pP016 + (size_t)nP016Pitch * nHeight, nP016Pitch, pNv12 + (size_t)nNv12Pitch * nHeight, nNv12Pitch,
+        (nWidth + 1) / 2 * 2, (nHeight + 1) / 2, 2, eDither);
+}
+
+/**
+* @brief YUV420P16 to IYUV. Like YuvConverter, the chroma planes are nWidth / 2 by nHeight / 2
+* and have half the luma pitch.
+*/
+inline void Yuv420P16ToIyuvHost(uint8_t *pSrc, int nSrcPitch, uint8_t *pDst, int nDstPitch, int nWidth, int nHeight, DitherMode eDither = DitherMode_None) {
+    const int nChromaWidth = nWidth / 2, nChromaHeight = nHeight / 2;
+    ConvertPlaneUInt16ToUInt8Host(pSrc, nSrcPitch, pDst, nDstPitch, nWidth, nHeight, 1, eDither);
+    for (int i = 0; i < 2; i++) {
+        size_t nSrcOffset = (size_t)nSrcPitch * nHeight + (size_t)(nSrcPitch / 2) * nChromaHeight * i,
+            nDstOffset = (size_t)nDstPitch * nHeight + (size_t)(nDstPitch / 2) * nChromaHeight * i;
+        ConvertPlaneUInt16ToUInt8Host(pSrc + nSrcOffset, nSrcPitch / 2, pDst + nDstOffset, nDstPitch / 2, nChromaWidth, nChromaHeight, 1, eDither);
+    }
+}
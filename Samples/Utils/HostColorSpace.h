@@ -0,0 +1,391 @@
+/*
+* Copyright 2017-2018 NVIDIA Corporation.  All rights reserved.
+*
+* Please refer to the NVIDIA end user license agreement (EULA) associated
+* with this source code for terms and conditions that govern your use of
+* this software. Any use, reproduction, disclosure, or distribution of
+* this software and related documentation outside the terms of the EULA
+* is strictly prohibited.
+*
+*/
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include "NvCodecUtils.h"
+
+/**
+* @brief Host versions of the conversions in ColorSpace.cu, for frames in system memory. They take
+* the same arguments and iMatrix values (ColorSpaceStandard) as the CUDA functions and produce the
+* same layouts, including the zero alpha channel and the untouched last row and column of odd-sized
+* frames. The math is fixed point, so results may differ from the GPU ones by 1 for 8-bit output,
+* and by a few units for 16-bit output. Rows are split across all cores, and the AVX2 paths are
+* used when the CPU supports them.
+*/
+
+// Same constants as GetConstants() in ColorSpace.cu
+inline void GetHostColorConstants(int iMatrix, float &wr, float &wb, int &black, int &white, int &max) {
+    // Default is BT709
+    wr = 0.2126f; wb = 0.0722f;
+    black = 16; white = 235;
+    max = 255;
+    if (iMatrix == 2) {
+        // BT601
+        wr = 0.2990f; wb = 0.1140f;
+    } else if (iMatrix == 4) {
+        // BT2020, 10-bit only
+        wr = 0.2627f; wb = 0.0593f;
+        black = 64 << 6; white = 940 << 6;
+        max = (1 << 16) - 1;
+    }
+}
+
+// Fixed-point matrices have this many fractional bits; 16-bit samples times the largest
+// coefficients still sum up within 32 bits
+static const int nHostColorFracBits = 13;
+
+inline void GetHostMatYuv2Rgb(int iMatrix, int32_t mat[3][3]) {
+    float wr, wb;
+    int black, white, max;
+    GetHostColorConstants(iMatrix, wr, wb, black, white, max);
+    float matf[3][3] = {
+        1.0f, 0.0f, (1.0f - wr) / 0.5f,
+        1.0f, -wb * (1.0f - wb) / 0.5f / (1 - wb - wr), -wr * (1 - wr) / 0.5f / (1 - wb - wr),
+        1.0f, (1.0f - wb) / 0.5f, 0.0f,
+    };
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            mat[i][j] = (int32_t)lrint(1.0 * max / (white - black) * matf[i][j] * (1 << nHostColorFracBits));
+        }
+    }
+}
+
+template<class YuvUnit, class RgbUnit>
+inline RgbUnit HostYuvToRgbUnit(int32_t x) {
+    const int32_t maxYuv = (1 << sizeof(YuvUnit) * 8) - 1;
+    x = x < 0 ? 0 : (x > maxYuv ? maxYuv : x);
+    return sizeof(YuvUnit) >= sizeof(RgbUnit) ? (RgbUnit)(x >> (sizeof(YuvUnit) - sizeof(RgbUnit)) * 8)
+        : (RgbUnit)(x << (sizeof(RgbUnit) - sizeof(YuvUnit)) * 8);
+}
+
+/**
+* @brief Converts pixels [x, nWidth) of one row. pDst is the BGRA row, or for planar output the
+* row in the B plane, with the G and R planes following at nPlaneSize byte intervals.
+*/
+template<class YuvUnit, class RgbUnit, bool bPlanar>
+inline void YuvToRgbRowHost(const YuvUnit *pY, const YuvUnit *pUV, int x, int nWidth, const int32_t mat[3][3], uint8_t *pDst, size_t nPlaneSize) {
+    const int
+        low = 1 << (sizeof(YuvUnit) * 8 - 4),
+        mid = 1 << (sizeof(YuvUnit) * 8 - 1);
+    RgbUnit *pRgb = (RgbUnit *)pDst;
+    const size_t nPlane = nPlaneSize / sizeof(RgbUnit);
+    for (; x < nWidth; x++) {
+        int32_t fy = (int32_t)pY[x] - low, fu = (int32_t)pUV[x & ~1] - mid, fv = (int32_t)pUV[x | 1] - mid;
+        RgbUnit
+            r = HostYuvToRgbUnit<YuvUnit, RgbUnit>((mat[0][0] * fy + mat[0][1] * fu + mat[0][2] * fv) >> nHostColorFracBits),
+            g = HostYuvToRgbUnit<YuvUnit, RgbUnit>((mat[1][0] * fy + mat[1][1] * fu + mat[1][2] * fv) >> nHostColorFracBits),
+            b = HostYuvToRgbUnit<YuvUnit, RgbUnit>((mat[2][0] * fy + mat[2][1] * fu + mat[2][2] * fv) >> nHostColorFracBits);
+        if (bPlanar) {
+            pRgb[x] = b;
+            pRgb[nPlane + x] = g;
+            pRgb[2 * nPlane + x] = r;
+        } else {
+            pRgb[4 * x] = b;
+            pRgb[4 * x + 1] = g;
+            pRgb[4 * x + 2] = r;
+            pRgb[4 * x + 3] = 0;
+        }
+    }
+}
+
+#ifdef HOST_AVX2
+/**
+* @brief AVX2 part of YuvToRgbRowHost(), eight pixels at a time; returns where the scalar code
+* has to take over.
+*/
+template<class YuvUnit, class RgbUnit, bool bPlanar>
+HOST_AVX2_TARGET inline int YuvToRgbRowAvx2(const YuvUnit *pY, const YuvUnit *pUV, int nWidth, const int32_t mat[3][3], uint8_t *pDst, size_t nPlaneSize) {
+    const __m256i
+        low = _mm256_set1_epi32(1 << (sizeof(YuvUnit) * 8 - 4)),
+        mid = _mm256_set1_epi32(1 << (sizeof(YuvUnit) * 8 - 1)),
+        zero = _mm256_setzero_si256(),
+        maxYuv = _mm256_set1_epi32((1 << sizeof(YuvUnit) * 8) - 1),
+        idxU = _mm256_setr_epi32(0, 0, 2, 2, 4, 4, 6, 6),
+        idxV = _mm256_setr_epi32(1, 1, 3, 3, 5, 5, 7, 7);
+    __m256i m[3][3];
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            m[i][j] = _mm256_set1_epi32(mat[i][j]);
+        }
+    }
+    RgbUnit *pRgb = (RgbUnit *)pDst;
+    const size_t nPlane = nPlaneSize / sizeof(RgbUnit);
+    int x = 0;
+    for (; x + 8 <= nWidth; x += 8) {
+        __m256i y = _mm256_sub_epi32(LoadUnitsAsInt32Avx2(pY + x), low), uv = LoadUnitsAsInt32Avx2(pUV + x);
+        __m256i u = _mm256_sub_epi32(_mm256_permutevar8x32_epi32(uv, idxU), mid),
+            v = _mm256_sub_epi32(_mm256_permutevar8x32_epi32(uv, idxV), mid);
+        // rgb[0..2] = r, g, b in RgbUnit range
+        __m256i rgb[3];
+        for (int i = 0; i < 3; i++) {
+            __m256i t = _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(m[i][0], y), _mm256_mullo_epi32(m[i][1], u)), _mm256_mullo_epi32(m[i][2], v));
+            t = _mm256_min_epi32(_mm256_max_epi32(_mm256_srai_epi32(t, nHostColorFracBits), zero), maxYuv);
+            if (sizeof(YuvUnit) > sizeof(RgbUnit)) {
+                t = _mm256_srli_epi32(t, 8);
+            } else if (sizeof(YuvUnit) < sizeof(RgbUnit)) {
+                t = _mm256_slli_epi32(t, 8);
+            }
+            rgb[i] = t;
+        }
+        if (bPlanar) {
+            StoreInt32AsUnitsAvx2(pRgb + x, rgb[2]);
+            StoreInt32AsUnitsAvx2(pRgb + nPlane + x, rgb[1]);
+            StoreInt32AsUnitsAvx2(pRgb + 2 * nPlane + x, rgb[0]);
+        } else if (sizeof(RgbUnit) == 1) {
+            __m256i bgra = _mm256_or_si256(_mm256_or_si256(rgb[2], _mm256_slli_epi32(rgb[1], 8)), _mm256_slli_epi32(rgb[0], 16));
+            _mm256_storeu_si256((__m256i *)(pRgb + 4 * x), bgra);
+        } else {
+            __m256i bg = _mm256_or_si256(rgb[2], _mm256_slli_epi32(rgb[1], 16));
+            __m256i lo = _mm256_unpacklo_epi32(bg, rgb[0]), hi = _mm256_unpackhi_epi32(bg, rgb[0]);
+            _mm256_storeu_si256((__m256i *)(pRgb + 4 * x), _mm256_permute2x128_si256(lo, hi, 0x20));
+            _mm256_storeu_si256((__m256i *)(pRgb + 4 * x + 16), _mm256_permute2x128_si256(lo, hi, 0x31));
+        }
+    }
+    return x;
+}
+#endif
+
+template<class YuvUnit, class RgbUnit, bool bPlanar>
+inline void YuvToRgbHost(uint8_t *pYuv, int nYuvPitch, uint8_t *pRgb, int nRgbPitch, int nWidth, int nHeight, int iMatrix) {
+    int32_t mat[3][3];
+    GetHostMatYuv2Rgb(iMatrix, mat);
+    // Like the CUDA kernels, convert whole 2x2 blocks only
+    const int nBlockWidth = nWidth & ~1;
+    const size_t nPlaneSize = (size_t)nRgbPitch * nHeight;
+    ParallelFor(nHeight / 2, [&](int iBegin, int iEnd) {
+        for (int y = iBegin * 2; y < iEnd * 2; y++) {
+            const YuvUnit *pY = (const YuvUnit *)(pYuv + (size_t)y * nYuvPitch),
+                *pUV = (const YuvUnit *)(pYuv + (size_t)(nHeight + y / 2) * nYuvPitch);
+            uint8_t *pDst = pRgb + (size_t)y * nRgbPitch;
+            int x = 0;
+#ifdef HOST_AVX2
+            if (IsAvx2Supported()) {
+                x = YuvToRgbRowAvx2<YuvUnit, RgbUnit, bPlanar>(pY, pUV, nBlockWidth, mat, pDst, nPlaneSize);
+            }
+#endif
+            YuvToRgbRowHost<YuvUnit, RgbUnit, bPlanar>(pY, pUV, x, nBlockWidth, mat, pDst, nPlaneSize);
+        }
+    }, 8, GetRowBandAlignment(2 * nRgbPitch));
+}
+
+inline void Nv12ToBgra32Host(uint8_t *pNv12, int nNv12Pitch, uint8_t *pBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 0) {
+    YuvToRgbHost<uint8_t, uint8_t, false>(pNv12, nNv12Pitch, pBgra, nBgraPitch, nWidth, nHeight, iMatrix);
+}
+
+inline void Nv12ToBgra64Host(uint8_t *pNv12, int nNv12Pitch, uint8_t *pBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 0) {
+    YuvToRgbHost<uint8_t, uint16_t, false>(pNv12, nNv12Pitch, pBgra, nBgraPitch, nWidth, nHeight, iMatrix);
+}
+
+inline void P016ToBgra32Host(uint8_t *pP016, int nP016Pitch, uint8_t *pBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 4) {
+    YuvToRgbHost<uint16_t, uint8_t, false>(pP016, nP016Pitch, pBgra, nBgraPitch, nWidth, nHeight, iMatrix);
+}
+
+inline void P016ToBgra64Host(uint8_t *pP016, int nP016Pitch, uint8_t *pBgra, int nBgraPitch, int nWidth, int nHeight, int iMatrix = 4) {
+    YuvToRgbHost<uint16_t, uint16_t, false>(pP016, nP016Pitch, pBgra, nBgraPitch, nWidth, nHeight, iMatrix);
+}
+
+inline void Nv12ToBgrPlanarHost(uint8_t *pNv12, int nNv12Pitch, uint8_t *pBgrp, int nBgrpPitch, int nWidth, int nHeight, int iMatrix = 0) {
+    YuvToRgbHost<uint8_t, uint8_t, true>(pNv12, nNv12Pitch, pBgrp, nBgrpPitch, nWidth, nHeight, iMatrix);
+}
+
+inline void P016ToBgrPlanarHost(uint8_t *pP016, int nP016Pitch, uint8_t *pBgrp, int nBgrpPitch, int nWidth, int nHeight, int iMatrix = 4) {
+    YuvToRgbHost<uint16_t, uint8_t, true>(pP016, nP016Pitch, pBgrp, nBgrpPitch, nWidth, nHeight, iMatrix);
+}
+
+inline void GetHostMatRgb2Yuv(int iMatrix, int32_t mat[3][3]) {
+    float wr, wb;
+    int black, white, max;
+    GetHostColorConstants(iMatrix, wr, wb, black, white, max);
+    float matf[3][3] = {
+        wr, 1.0f - wb - wr, wb,
+        -0.5f * wr / (1.0f - wb), -0.5f * (1 - wb - wr) / (1.0f - wb), 0.5f,
+        0.5f, -0.5f * (1.0f - wb - wr) / (1.0f - wr), -0.5f * wb / (1.0f - wr),
+    };
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            mat[i][j] = (int32_t)lrint(1.0 * (white - black) / max * matf[i][j] * (1 << nHostColorFracBits));
+        }
+    }
+}
+
+/**
+* @brief Brings an RGB component to the YuvUnit range; 8-bit RGB feeding 16-bit YUV is stretched
+* by 257 so that white stays white.
+*/
+template<class RgbUnit, class YuvUnit>
+inline int32_t HostRgbToYuvRange(RgbUnit x) {
+    return sizeof(RgbUnit) < sizeof(YuvUnit) ? (int32_t)x * 257
+        : (sizeof(RgbUnit) > sizeof(YuvUnit) ? (int32_t)x >> 8 : (int32_t)x);
+}
+
+/**
+* @brief Rounds a fixed-point YUV value with nFracBits fractional bits to nYuvBits, adds the
+* offset and puts the result in the high bits of the YuvUnit, as P010 wants it.
+*/
+template<class YuvUnit, int nYuvBits>
+inline YuvUnit HostFixedToYuv(int32_t x, int nFracBits, int32_t offset) {
+    const int nShift = sizeof(YuvUnit) * 8 - nYuvBits;
+    x = ((x + (1 << (nFracBits + nShift - 1))) >> (nFracBits + nShift)) + (offset >> nShift);
+    x = x < 0 ? 0 : (x > (1 << nYuvBits) - 1 ? (1 << nYuvBits) - 1 : x);
+    return (YuvUnit)(x << nShift);
+}
+
+/**
+* @brief Converts 2x2 blocks [x, nWidth) of a row pair: luma goes to pY0 and pY1, and the
+* chroma of the averaged block to the interleaved pUV.
+*/
+template<class RgbUnit, class YuvUnit, int nYuvBits>
+inline void RgbToYuvRowPairHost(const RgbUnit *pRgb0, const RgbUnit *pRgb1, YuvUnit *pY0, YuvUnit *pY1, YuvUnit *pUV, int x, int nWidth, const int32_t mat[3][3]) {
+    const int32_t
+        low = 1 << (sizeof(YuvUnit) * 8 - 4),
+        mid = 1 << (sizeof(YuvUnit) * 8 - 1);
+    for (; x < nWidth; x += 2) {
+        int32_t rs = 0, gs = 0, bs = 0;
+        for (int i = 0; i < 4; i++) {
+            const RgbUnit *p = (i < 2 ? pRgb0 : pRgb1) + 4 * (x + (i & 1));
+            int32_t
+                b = HostRgbToYuvRange<RgbUnit, YuvUnit>(p[0]),
+                g = HostRgbToYuvRange<RgbUnit, YuvUnit>(p[1]),
+                r = HostRgbToYuvRange<RgbUnit, YuvUnit>(p[2]);
+            (i < 2 ? pY0 : pY1)[x + (i & 1)] = HostFixedToYuv<YuvUnit, nYuvBits>(mat[0][0] * r + mat[0][1] * g + mat[0][2] * b, nHostColorFracBits, low);
+            rs += r;
+            gs += g;
+            bs += b;
+        }
+        // The block sums carry two more fractional bits
+        pUV[x] = HostFixedToYuv<YuvUnit, nYuvBits>(mat[1][0] * rs + mat[1][1] * gs + mat[1][2] * bs, nHostColorFracBits + 2, mid);
+        pUV[x + 1] = HostFixedToYuv<YuvUnit, nYuvBits>(mat[2][0] * rs + mat[2][1] * gs + mat[2][2] * bs, nHostColorFracBits + 2, mid);
+    }
+}
+
+#ifdef HOST_AVX2
+/**
+* @brief Loads eight BGRA pixels as B, G and R vectors of 32-bit values in the YuvUnit range
+*/
+template<class RgbUnit, class YuvUnit>
+HOST_AVX2_TARGET inline void LoadBgraAvx2(const RgbUnit *p, __m256i *pb, __m256i *pg, __m256i *pr) {
+    __m256i b, g, r;
+    if (sizeof(RgbUnit) == 1) {
+        const __m256i mask = _mm256_set1_epi32(0xFF);
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        b = _mm256_and_si256(v, mask);
+        g = _mm256_and_si256(_mm256_srli_epi32(v, 8), mask);
+        r = _mm256_and_si256(_mm256_srli_epi32(v, 16), mask);
+    } else {
+        // Each pixel is a BG dword followed by an RA dword
+        const __m256i mask = _mm256_set1_epi32(0xFFFF), idx = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+        __m256i v0 = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i *)p), idx),
+            v1 = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((const __m256i *)(p + 16)), idx);
+        __m256i bg = _mm256_permute2x128_si256(v0, v1, 0x20), ra = _mm256_permute2x128_si256(v0, v1, 0x31);
+        b = _mm256_and_si256(bg, mask);
+        g = _mm256_srli_epi32(bg, 16);
+        r = _mm256_and_si256(ra, mask);
+    }
+    if (sizeof(RgbUnit) < sizeof(YuvUnit)) {
+        b = _mm256_or_si256(b, _mm256_slli_epi32(b, 8));
+        g = _mm256_or_si256(g, _mm256_slli_epi32(g, 8));
+        r = _mm256_or_si256(r, _mm256_slli_epi32(r, 8));
+    } else if (sizeof(RgbUnit) > sizeof(YuvUnit)) {
+        b = _mm256_srli_epi32(b, 8);
+        g = _mm256_srli_epi32(g, 8);
+        r = _mm256_srli_epi32(r, 8);
+    }
+    *pb = b;
+    *pg = g;
+    *pr = r;
+}
+
+template<class YuvUnit, int nYuvBits>
+HOST_AVX2_TARGET inline __m256i FixedToYuvAvx2(__m256i x, int nFracBits, int32_t offset) {
+    const int nShift = sizeof(YuvUnit) * 8 - nYuvBits;
+    x = _mm256_add_epi32(x, _mm256_set1_epi32(1 << (nFracBits + nShift - 1)));
+    x = _mm256_add_epi32(_mm256_srai_epi32(x, nFracBits + nShift), _mm256_set1_epi32(offset >> nShift));
+    x = _mm256_min_epi32(_mm256_max_epi32(x, _mm256_setzero_si256()), _mm256_set1_epi32((1 << nYuvBits) - 1));
+    return _mm256_slli_epi32(x, nShift);
+}
+
+template<class RgbUnit, class YuvUnit, int nYuvBits>
+HOST_AVX2_TARGET inline int RgbToYuvRowPairAvx2(const RgbUnit *pRgb0, const RgbUnit *pRgb1, YuvUnit *pY0, YuvUnit *pY1, YuvUnit *pUV, int nWidth, const int32_t mat[3][3]) {
+    const int32_t
+        low = 1 << (sizeof(YuvUnit) * 8 - 4),
+        mid = 1 << (sizeof(YuvUnit) * 8 - 1);
+    __m256i m[3][3];
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+            m[i][j] = _mm256_set1_epi32(mat[i][j]);
+        }
+    }
+    int x = 0;
+    for (; x + 8 <= nWidth; x += 8) {
+        __m256i b0, g0, r0, b1, g1, r1;
+        LoadBgraAvx2<RgbUnit, YuvUnit>(pRgb0 + 4 * x, &b0, &g0, &r0);
+        LoadBgraAvx2<RgbUnit, YuvUnit>(pRgb1 + 4 * x, &b1, &g1, &r1);
+        __m256i y0 = _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(m[0][0], r0), _mm256_mullo_epi32(m[0][1], g0)), _mm256_mullo_epi32(m[0][2], b0)),
+            y1 = _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(m[0][0], r1), _mm256_mullo_epi32(m[0][1], g1)), _mm256_mullo_epi32(m[0][2], b1));
+        StoreInt32AsUnitsAvx2(pY0 + x, FixedToYuvAvx2<YuvUnit, nYuvBits>(y0, nHostColorFracBits, low));
+        StoreInt32AsUnitsAvx2(pY1 + x, FixedToYuvAvx2<YuvUnit, nYuvBits>(y1, nHostColorFracBits, low));
+        // Block sums end up in dwords 0, 1, 4 and 5
+        __m256i rs = _mm256_add_epi32(r0, r1), gs = _mm256_add_epi32(g0, g1), bs = _mm256_add_epi32(b0, b1);
+        rs = _mm256_hadd_epi32(rs, rs);
+        gs = _mm256_hadd_epi32(gs, gs);
+        bs = _mm256_hadd_epi32(bs, bs);
+        __m256i u = _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(m[1][0], rs), _mm256_mullo_epi32(m[1][1], gs)), _mm256_mullo_epi32(m[1][2], bs)),
+            v = _mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(m[2][0], rs), _mm256_mullo_epi32(m[2][1], gs)), _mm256_mullo_epi32(m[2][2], bs));
+        u = FixedToYuvAvx2<YuvUnit, nYuvBits>(u, nHostColorFracBits + 2, mid);
+        v = FixedToYuvAvx2<YuvUnit, nYuvBits>(v, nHostColorFracBits + 2, mid);
+        StoreInt32AsUnitsAvx2(pUV + x, _mm256_unpacklo_epi32(u, v));
+    }
+    return x;
+}
+#endif
+
+template<class RgbUnit, class YuvUnit, int nYuvBits>
+inline void RgbToYuvHost(uint8_t *pRgb, int nRgbPitch, uint8_t *pYuv, int nYuvPitch, int nWidth, int nHeight, int iMatrix) {
+    int32_t mat[3][3];
+    GetHostMatRgb2Yuv(iMatrix, mat);
+    const int nBlockWidth = nWidth & ~1;
+    ParallelFor(nHeight / 2, [&](int iBegin, int iEnd) {
+        for (int y = iBegin * 2; y < iEnd * 2; y += 2) {
+            const RgbUnit *pRgb0 = (const RgbUnit *)(pRgb + (size_t)y * nRgbPitch),
+                *pRgb1 = (const RgbUnit *)(pRgb + (size_t)(y + 1) * nRgbPitch);
+            YuvUnit *pY0 = (YuvUnit *)(pYuv + (size_t)y * nYuvPitch),
+                *pY1 = (YuvUnit *)(pYuv + (size_t)(y + 1) * nYuvPitch),
+                *pUV = (YuvUnit *)(pYuv + (size_t)(nHeight + y / 2) * nYuvPitch);
+            int x = 0;
+#ifdef HOST_AVX2
+            if (IsAvx2Supported()) {
+                x = RgbToYuvRowPairAvx2<RgbUnit, YuvUnit, nYuvBits>(pRgb0, pRgb1, pY0, pY1, pUV, nBlockWidth, mat);
+            }
+#endif
+            RgbToYuvRowPairHost<RgbUnit, YuvUnit, nYuvBits>(pRgb0, pRgb1, pY0, pY1, pUV, x, nBlockWidth, mat);
+        }
+    }, 8, GetRowBandAlignment(nYuvPitch));
+}
+
+/**
+* @brief BGRA32 to NV12, for uploading host RGB captures at 12 bits per pixel instead of 32
+*/
+inline void BgraToNv12Host(uint8_t *pBgra, int nBgraPitch, uint8_t *pNv12, int nNv12Pitch, int nWidth, int nHeight, int iMatrix = 0) {
+    RgbToYuvHost<uint8_t, uint8_t, 8>(pBgra, nBgraPitch, pNv12, nNv12Pitch, nWidth, nHeight, iMatrix);
+}
+
+/**
+* @brief BGRA32 to P010, rounded to 10 bits in the high bits of each sample
+*/
+inline void BgraToP010Host(uint8_t *pBgra, int nBgraPitch, uint8_t *pP010, int nP010Pitch, int nWidth, int nHeight, int iMatrix = 4) {
+    RgbToYuvHost<uint8_t, uint16_t, 10>(pBgra, nBgraPitch, pP010, nP010Pitch, nWidth, nHeight, iMatrix);
+}
+
+inline void Bgra64ToP016Host(uint8_t *pBgra, int nBgraPitch, uint8_t *pP016, int nP016Pitch, int nWidth, int nHeight, int iMatrix = 4) {
+    RgbToYuvHost<uint16_t, uint16_t, 16>(pBgra, nBgraPitch, pP016, nP016Pitch, nWidth, nHeight, iMatrix);
+}
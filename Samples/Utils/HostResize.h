@@ -0,0 +1,322 @@
+/*
+* Copyright 2017-2018 NVIDIA Corporation.  All rights reserved.
+*
+* Please refer to the NVIDIA end user license agreement (EULA) associated
+* with this source code for terms and conditions that govern your use of
+* this software. Any use, reproduction, disclosure, or distribution of
+* this software and related documentation outside the terms of the EULA
+* is strictly prohibited.
+*
+*/
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <functional>
+#include <vector>
+#include "NvCodecUtils.h"
+
+/**
+* @brief Host versions of the scalers in Resize.cu. The linear filter emulates the texture
+* filtering the CUDA kernels rely on: the same sample positions, edge clamping, weights rounded to
+* 8 fractional bits and the same output scaling, so results match the GPU up to rounding. The area
+* filter averages the source footprint of each output sample instead, for downscaling without
+* aliasing. Both are separable and computed in fixed point; each thread scales a band of output
+* rows, keeping the horizontally filtered source rows it needs, and both passes use AVX2 when the
+* CPU supports it. The AVX2 and the scalar paths give identical results.
+*/
+
+typedef enum HostScaleFilter {
+    // Bilinear, as sampled through the texture unit by the CUDA kernels
+    HostScaleFilter_Linear = 0,
+    // Box average over the footprint of each output sample; axes that are upscaled stay linear
+    HostScaleFilter_Area = 1
+} HostScaleFilter;
+
+/**
+* @brief Source taps and weights along one axis. Output sample i is the sum over k of the source
+* element vTap[k * nSample + i] times vWeight[k * nSample + i]; the weights of a sample add up to
+* nWeightOne. With nChannel interleaved channels there are nChannel samples per output position,
+* and the taps are element indices.
+*/
+struct HostScaleAxis {
+    // 12 fractional bits; linear weights only use the upper 8, like the texture unit
+    static const int nWeightOne = 1 << 12;
+    int nTap = 0, nSample = 0;
+    std::vector<int> vTap, vWeight;
+
+    /**
+    *   @brief  fnPos(i) is the texture coordinate sampled for output i. Linear taps are the
+    *   texels around fnPos(i) - 0.5, like the texture unit uses; area taps are the texels
+    *   covering [fnPos(i), fnPos(i) + fStep), fStep being the source length of one output. Taps
+    *   are clamped to [0, nSrc).
+    */
+    HostScaleAxis(int nDst, int nSrc, const std::function<float(int)> &fnPos, float fStep, HostScaleFilter eFilter, int nChannel = 1) {
+        const bool bArea = eFilter == HostScaleFilter_Area && fStep > 1.0f;
+        std::vector<int> viFirst(nDst);
+        std::vector<std::vector<int>> vvWeight(nDst);
+        for (int i = 0; i < nDst; i++) {
+            std::vector<int> &vw = vvWeight[i];
+            if (!bArea) {
+                float fPos = fnPos(i) - 0.5f, fFloor = floorf(fPos);
+                int w = (int)roundf((fPos - fFloor) * 256.0f) * (nWeightOne / 256);
+                viFirst[i] = (int)fFloor;
+                vw.push_back(nWeightOne - w);
+                vw.push_back(w);
+            } else {
+                float fBegin = fnPos(i), fEnd = fBegin + fStep;
+                viFirst[i] = (int)floorf(fBegin);
+                // The coverage is rounded cumulatively, so the weights add up exactly and the
+                // rounding errors don't pile up over the footprint
+                int nCover = 0;
+                for (int j = viFirst[i]; j < fEnd; j++) {
+                    int nNext = j + 1.0f >= fEnd ? nWeightOne : (int)roundf((j + 1.0f - fBegin) / fStep * nWeightOne);
+                    vw.push_back(nNext - nCover);
+                    nCover = nNext;
+                }
+            }
+            nTap = (std::max)(nTap, (int)vw.size());
+        }
+
+        nSample = nDst * nChannel;
+        vTap.resize((size_t)nTap * nSample);
+        vWeight.resize((size_t)nTap * nSample);
+        for (int i = 0; i < nDst; i++) {
+            for (int k = 0; k < nTap; k++) {
+                // Padding taps repeat the last one with weight 0
+                int n = (int)vvWeight[i].size(), iTap = viFirst[i] + (std::min)(k, n - 1);
+                iTap = (std::min)((std::max)(iTap, 0), nSrc - 1);
+                for (int c = 0; c < nChannel; c++) {
+                    size_t iSample = (size_t)k * nSample + i * nChannel + c;
+                    vTap[iSample] = iTap * nChannel + c;
+                    vWeight[iSample] = k < n ? vvWeight[i][k] : 0;
+                }
+            }
+        }
+    }
+    /**
+    *   @brief  Number of leading samples whose taps all lie below nEnd
+    */
+    int GetSampleCountBelow(int nEnd) const {
+        int i = 0;
+        for (; i < nSample; i++) {
+            for (int k = 0; k < nTap; k++) {
+                if (vTap[(size_t)k * nSample + i] >= nEnd) {
+                    return i;
+                }
+            }
+        }
+        return i;
+    }
+};
+
+/**
+* @brief Bits the horizontally filtered rows are shifted right by: they keep 12 fractional bits for
+* 8-bit samples and 4 for 16-bit ones, so the vertical sums still fit in 32 bits.
+*/
+template<class T>
+constexpr int GetScaleRowShift() {
+    return sizeof(T) == 1 ? 0 : 8;
+}
+
+/**
+* @brief Filters one source row horizontally into pRow from sample x on
+*/
+template<class T>
+inline void ScaleRowHorizontal(const T *pSrc, const HostScaleAxis &xAxis, int32_t *pRow, int x) {
+    const int nShift = GetScaleRowShift<T>();
+    for (; x < xAxis.nSample; x++) {
+        int32_t v = (1 << nShift) >> 1;
+        for (int k = 0; k < xAxis.nTap; k++) {
+            size_t i = (size_t)k * xAxis.nSample + x;
+            v += pSrc[xAxis.vTap[i]] * xAxis.vWeight[i];
+        }
+        pRow[x] = v >> nShift;
+    }
+}
+
+/**
+* @brief Blends the filtered rows apRow[k] with the weights aWeight[k] from sample x on. The sum
+* is rounded to 8 fractional bits, which leaves it exact in single precision, then multiplied by
+* fScale, truncated and saturated.
+*/
+template<class T>
+inline void ScaleRowVertical(const int32_t *const *apRow, const int *aWeight, int nTap, float fScale, T *pDst, int x, int n) {
+    const int nShift = 16 - GetScaleRowShift<T>();
+    const float fMax = (float)((1 << sizeof(T) * 8) - 1);
+    for (; x < n; x++) {
+        // The sum takes all 32 bits at full scale, so it's unsigned
+        uint32_t v = 1u << (nShift - 1);
+        for (int k = 0; k < nTap; k++) {
+            v += (uint32_t)apRow[k][x] * (uint32_t)aWeight[k];
+        }
+        float f = (float)(int32_t)(v >> nShift) * fScale;
+        pDst[x] = (T)(f > fMax ? fMax : f);
+    }
+}
+
+#ifdef HOST_AVX2
+/**
+* @brief Gathers 32 bits per tap, so it must stop at nEnd, the first sample with a tap in the last
+* 4 bytes of the row.
+*/
+template<class T>
+HOST_AVX2_TARGET inline int ScaleRowHorizontalAvx2(const T *pSrc, const HostScaleAxis &xAxis, int nEnd, int32_t *pRow) {
+    const __m256i vMask = _mm256_set1_epi32(sizeof(T) == 1 ? 0xFF : 0xFFFF);
+    int x = 0;
+    for (; x + 8 <= nEnd; x += 8) {
+        __m256i v = _mm256_set1_epi32((1 << GetScaleRowShift<T>()) >> 1);
+        for (int k = 0; k < xAxis.nTap; k++) {
+            size_t i = (size_t)k * xAxis.nSample + x;
+            __m256i vTap = _mm256_loadu_si256((const __m256i *)(xAxis.vTap.data() + i));
+            __m256i vSrc = _mm256_and_si256(_mm256_i32gather_epi32((const int *)pSrc, vTap, sizeof(T)), vMask);
+            v = _mm256_add_epi32(v, _mm256_mullo_epi32(vSrc, _mm256_loadu_si256((const __m256i *)(xAxis.vWeight.data() + i))));
+        }
+        _mm256_storeu_si256((__m256i *)(pRow + x), _mm256_srli_epi32(v, GetScaleRowShift<T>()));
+    }
+    return x;
+}
+
+template<class T>
+HOST_AVX2_TARGET inline int ScaleRowVerticalAvx2(const int32_t *const *apRow, const int *aWeight, int nTap, float fScale, T *pDst, int n) {
+    const __m256 vScale = _mm256_set1_ps(fScale), vMax = _mm256_set1_ps((float)((1 << sizeof(T) * 8) - 1));
+    int x = 0;
+    for (; x + 8 <= n; x += 8) {
+        __m256i v = _mm256_set1_epi32(1 << (15 - GetScaleRowShift<T>()));
+        for (int k = 0; k < nTap; k++) {
+            v = _mm256_add_epi32(v, _mm256_mullo_epi32(_mm256_loadu_si256((const __m256i *)(apRow[k] + x)), _mm256_set1_epi32(aWeight[k])));
+        }
+        __m256 f = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(v, 16 - GetScaleRowShift<T>())), vScale);
+        StoreInt32AsUnitsAvx2(pDst + x, _mm256_cvttps_epi32(_mm256_min_ps(f, vMax)));
+    }
+    return x;
+}
+#endif
+
+/**
+* @brief Scales one plane of nChannel-interleaved T samples. fnPosX and fnPosY give the texture
+* coordinates the CUDA kernel samples for each output column and row, fStepX and fStepY the source
+* length of one output sample.
+*/
+template<class T, int nChannel>
+inline void ScalePlaneHost(const uint8_t *pSrc, int nSrcPitch, int nSrcWidth, int nSrcHeight, uint8_t *pDst, int nDstPitch, int nDstWidth, int nDstHeight,
+    const std::function<float(int)> &fnPosX, const std::function<float(int)> &fnPosY, float fStepX, float fStepY, float fOutScale, HostScaleFilter eFilter) {
+    if (nSrcWidth <= 0 || nSrcHeight <= 0 || nDstWidth <= 0 || nDstHeight <= 0) {
+        return;
+    }
+    const HostScaleAxis xAxis(nDstWidth, nSrcWidth, fnPosX, fStepX, eFilter, nChannel), yAxis(nDstHeight, nSrcHeight, fnPosY, fStepY, eFilter);
+    const int nRowSize = xAxis.nSample, nTap = yAxis.nTap;
+    const int nGatherEnd = xAxis.GetSampleCountBelow(nSrcWidth * nChannel - (4 / (int)sizeof(T) - 1));
+    // ScaleRowVertical() leaves 8 fractional bits
+    const float fScale = fOutScale / 256.0f;
+    ParallelFor(nDstHeight, [&](int iBegin, int iEnd) {
+        // One filtered row per vertical tap. Consecutive output rows mostly share source rows, so
+        // the filtered rows are kept and only the missing ones are filtered.
+        std::vector<int32_t> vRow((size_t)nTap * nRowSize);
+        std::vector<int> viRow(nTap, -1), viSlot(nTap), vWeight(nTap);
+        std::vector<bool> vbUsed(nTap);
+        std::vector<const int32_t *> vpRow(nTap);
+        auto Fill = [&](int iSlot, int iRow) {
+            const T *pSrcRow = (const T *)(pSrc + (size_t)iRow * nSrcPitch);
+            int32_t *pRow = vRow.data() + (size_t)iSlot * nRowSize;
+            int x = 0;
+#ifdef HOST_AVX2
+            if (IsAvx2Supported()) {
+                x = ScaleRowHorizontalAvx2(pSrcRow, xAxis, nGatherEnd, pRow);
+            }
+#endif
+            ScaleRowHorizontal(pSrcRow, xAxis, pRow, x);
+            viRow[iSlot] = iRow;
+        };
+        for (int y = iBegin; y < iEnd; y++) {
+            std::fill(vbUsed.begin(), vbUsed.end(), false);
+            for (int k = 0; k < nTap; k++) {
+                viSlot[k] = (int)(std::find(viRow.begin(), viRow.end(), yAxis.vTap[(size_t)k * nDstHeight + y]) - viRow.begin());
+                if (viSlot[k] < nTap) {
+                    vbUsed[viSlot[k]] = true;
+                }
+            }
+            for (int k = 0; k < nTap; k++) {
+                int iRow = yAxis.vTap[(size_t)k * nDstHeight + y];
+                if (viSlot[k] == nTap) {
+                    // A row filled for an earlier tap, or else a slot this output row doesn't need
+                    viSlot[k] = (int)(std::find(viRow.begin(), viRow.end(), iRow) - viRow.begin());
+                    if (viSlot[k] == nTap) {
+                        viSlot[k] = (int)(std::find(vbUsed.begin(), vbUsed.end(), false) - vbUsed.begin());
+                        vbUsed[viSlot[k]] = true;
+                        Fill(viSlot[k], iRow);
+                    }
+                }
+                vpRow[k] = vRow.data() + (size_t)viSlot[k] * nRowSize;
+                vWeight[k] = yAxis.vWeight[(size_t)k * nDstHeight + y];
+            }
+            T *pDstRow = (T *)(pDst + (size_t)y * nDstPitch);
+            int x = 0;
+#ifdef HOST_AVX2
+            if (IsAvx2Supported()) {
+                x = ScaleRowVerticalAvx2(vpRow.data(), vWeight.data(), nTap, fScale, pDstRow, nRowSize);
+            }
+#endif
+            ScaleRowVertical(vpRow.data(), vWeight.data(), nTap, fScale, pDstRow, x, nRowSize);
+        }
+    }, 16, GetRowBandAlignment(nDstPitch));
+}
+
+template<class T>
+inline void ResizeHost(uint8_t *pDst, uint8_t *pDstUV, int nDstPitch, int nDstWidth, int nDstHeight, uint8_t *pSrc, int nSrcPitch, int nSrcWidth, int nSrcHeight,
+    HostScaleFilter eFilter) {
+    const float fxScale = 1.0f * nDstWidth / nSrcWidth, fyScale = 1.0f * nDstHeight / nSrcHeight;
+    // The kernel multiplies normalized texels by 1 << bits, not by the maximum value; here the
+    // result saturates instead of wrapping around at full scale
+    const float fOutScale = (float)(1 << sizeof(T) * 8) / ((1 << sizeof(T) * 8) - 1);
+    // Each kernel thread writes a 2x2 luma block and one chroma pair
+    ScalePlaneHost<T, 1>(pSrc, nSrcPitch, nSrcWidth, nSrcHeight, pDst, nDstPitch, nDstWidth / 2 * 2, nDstHeight / 2 * 2,
+        [fxScale](int x) { return x / fxScale; }, [fyScale](int y) { return y / fyScale; }, 1.0f / fxScale, 1.0f / fyScale, fOutScale, eFilter);
+    // Chroma is sampled from the whole frame texture, at row (nDstHeight + iy) / fyScale + 0.5f
+    ScalePlaneHost<T, 2>(pSrc + (size_t)nSrcPitch * nSrcHeight, nSrcPitch, nSrcWidth / 2, nSrcHeight / 2, pDstUV, nDstPitch, nDstWidth / 2, nDstHeight / 2,
+        [fxScale](int x) { return x / fxScale; }, [fyScale, nDstHeight, nSrcHeight](int y) { return (nDstHeight + y) / fyScale + 0.5f - nSrcHeight; },
+        1.0f / fxScale, 1.0f / fyScale, fOutScale, eFilter);
+}
+
+inline void ResizeNv12Host(unsigned char *pDstNv12, int nDstPitch, int nDstWidth, int nDstHeight, unsigned char *pSrcNv12, int nSrcPitch, int nSrcWidth, int nSrcHeight, unsigned char *pDstNv12UV = nullptr,
+    HostScaleFilter eFilter = HostScaleFilter_Linear) {
+    unsigned char *pDstUV = pDstNv12UV ? pDstNv12UV : pDstNv12 + (nDstPitch * nDstHeight);
+    ResizeHost<uint8_t>(pDstNv12, pDstUV, nDstPitch, nDstWidth, nDstHeight, pSrcNv12, nSrcPitch, nSrcWidth, nSrcHeight, eFilter);
+}
+
+inline void ResizeP016Host(unsigned char *pDstP016, int nDstPitch, int nDstWidth, int nDstHeight, unsigned char *pSrcP016, int nSrcPitch, int nSrcWidth, int nSrcHeight, unsigned char *pDstP016UV = nullptr,
+    HostScaleFilter eFilter = HostScaleFilter_Linear) {
+    unsigned char *pDstUV = pDstP016UV ? pDstP016UV : pDstP016 + (nDstPitch * nDstHeight);
+    ResizeHost<uint16_t>(pDstP016, pDstUV, nDstPitch, nDstWidth, nDstHeight, pSrcP016, nSrcPitch, nSrcWidth, nSrcHeight, eFilter);
+}
+
+inline void ScaleYUV420Host(unsigned char *pDstY, unsigned char *pDstU, unsigned char *pDstV, int nDstPitch, int nDstChromaPitch, int nDstWidth, int nDstHeight,
+    unsigned char *pSrcY, unsigned char *pSrcU, unsigned char *pSrcV, int nSrcPitch, int nSrcChromaPitch, int nSrcWidth, int nSrcHeight, bool bSemiplanar,
+    HostScaleFilter eFilter = HostScaleFilter_Linear) {
+    int chromaWidthDst = (nDstWidth + 1) / 2;
+    int chromaHeightDst = (nDstHeight + 1) / 2;
+
+    int chromaWidthSrc = (nSrcWidth + 1) / 2;
+    int chromaHeightSrc = (nSrcHeight + 1) / 2;
+
+    // Scale() samples at x * nSrcWidth / nDstWidth of the plane it works on
+    auto Scale = [eFilter](int nChannel, unsigned char *pDst, int nDstPitch, int nDstWidth, int nDstHeight, unsigned char *pSrc, int nSrcPitch, int nSrcWidth, int nSrcHeight) {
+        const float fxScale = 1.0f * nSrcWidth / nDstWidth, fyScale = 1.0f * nSrcHeight / nDstHeight;
+        std::function<float(int)> fnPosX = [fxScale](int x) { return x * fxScale; }, fnPosY = [fyScale](int y) { return y * fyScale; };
+        if (nChannel == 2) {
+            ScalePlaneHost<uint8_t, 2>(pSrc, nSrcPitch, nSrcWidth, nSrcHeight, pDst, nDstPitch, nDstWidth, nDstHeight, fnPosX, fnPosY, fxScale, fyScale, 1.0f, eFilter);
+        } else {
+            ScalePlaneHost<uint8_t, 1>(pSrc, nSrcPitch, nSrcWidth, nSrcHeight, pDst, nDstPitch, nDstWidth, nDstHeight, fnPosX, fnPosY, fxScale, fyScale, 1.0f, eFilter);
+        }
+    };
+
+    Scale(1, pDstY, nDstPitch, nDstWidth, nDstHeight, pSrcY, nSrcPitch, nSrcWidth, nSrcHeight);
+
+    if (bSemiplanar) {
+        Scale(2, pDstU, nDstChromaPitch, chromaWidthDst, chromaHeightDst, pSrcU, nSrcChromaPitch, chromaWidthSrc, chromaHeightSrc);
+    } else {
+        Scale(1, pDstU, nDstChromaPitch, chromaWidthDst, chromaHeightDst, pSrcU, nSrcChromaPitch, chromaWidthSrc, chromaHeightSrc);
+        Scale(1, pDstV, nDstChromaPitch, chromaWidthDst, chromaHeightDst, pSrcV, nSrcChromaPitch, chromaWidthSrc, chromaHeightSrc);
+    }
+}
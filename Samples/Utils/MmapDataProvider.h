@@ -0,0 +1,79 @@
+/*
+* Copyright 2017-2018 NVIDIA Corporation.  All rights reserved.
+*
+* Please refer to the NVIDIA end user license agreement (EULA) associated
+* with this source code for terms and conditions that govern your use of
+* this software. Any use, reproduction, disclosure, or distribution of
+* this software and related documentation outside the terms of the EULA
+* is strictly prohibited.
+*
+*/
+#pragma once
+
+#include "NvCodecUtils.h"
+#include "FFmpegDemuxer.h"
+
+/**
+* @brief DataProvider that serves a memory-mapped file. Each read is a single copy from the page
+* cache into the AVIO buffer. Read-ahead is requested one window ahead of the read position, and
+* pages more than a window behind it are dropped from the mapping, so the resident set of a
+* demuxer stays around two windows regardless of the file size. The provider is seekable, so
+* files with the index at the end (MP4 moov atom) can be demuxed.
+*/
+class MmapDataProvider : public FFmpegDemuxer::DataProvider {
+public:
+    MmapDataProvider(const char *szFilePath, uint64_t nWindow = 4 * 1024 * 1024) : file(szFilePath), nWindow(nWindow) {
+        if (!file.GetData()) {
+            LOG(ERROR) << "Unable to map input file: " << szFilePath;
+            return;
+        }
+        file.AdviseSequential();
+        file.WillNeed(0, nWindow);
+        nReadAheadEnd = nWindow;
+    }
+    int GetData(uint8_t *pBuf, int nBuf) {
+        if (nPos >= file.GetSize()) {
+            return 0;
+        }
+        int n = (int)std::min((uint64_t)nBuf, file.GetSize() - nPos);
+
+        if (nPos + n + nWindow / 2 > nReadAheadEnd) {
+            nReadAheadEnd = std::max(nReadAheadEnd, nPos + n);
+            file.WillNeed(nReadAheadEnd, nWindow);
+            nReadAheadEnd += nWindow;
+        }
+        if (nPos > nReleaseEnd + 2 * nWindow) {
+            file.DontNeed(nReleaseEnd, nPos - nWindow - nReleaseEnd);
+            nReleaseEnd = nPos - nWindow;
+        }
+
+        memcpy(pBuf, file.GetData() + nPos, n);
+        nPos += n;
+        return n;
+    }
+    int64_t Seek(int64_t nOffset, int iWhence) {
+        int64_t nBase;
+        switch (iWhence) {
+        case SEEK_SET: nBase = 0; break;
+        case SEEK_CUR: nBase = (int64_t)nPos; break;
+        case SEEK_END: nBase = (int64_t)file.GetSize(); break;
+        default: return -1;
+        }
+        if (!file.GetData() || nBase + nOffset < 0) {
+            return -1;
+        }
+        nPos = nBase + nOffset;
+        // Restart the read-ahead window at the new position
+        nReadAheadEnd = nPos;
+        nReleaseEnd = std::min(nReleaseEnd, nPos);
+        return nPos;
+    }
+    int64_t GetSize() {
+        return file.GetData() ? (int64_t)file.GetSize() : -1;
+    }
+
+private:
+    MappedFile file;
+    uint64_t nWindow;
+    uint64_t nPos = 0, nReadAheadEnd = 0, nReleaseEnd = 0;
+};
@@ -14,10 +14,48 @@
 #include <chrono>
 #include <sys/stat.h>
 #include <assert.h>
+#include <ctype.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "Logger.h"
 #include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <fstream>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
+#ifdef __linux__
+#include <sched.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define YUV_CONVERTER_SSE2
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define YUV_CONVERTER_NEON
+#endif
+// Host pixel kernels compile their AVX2 paths regardless of the build flags and pick them at run time
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#ifdef _MSC_VER
+#include <intrin.h>
+#define HOST_AVX2_TARGET
+#else
+#include <immintrin.h>
+#define HOST_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#define HOST_AVX2
+#endif
 
 extern simplelogger::Logger *logger;
 
@@ -150,121 +188,1023 @@ private:
     std::thread t;
 };
 
+/**
+* @brief Bounded lock-free single-producer/single-consumer ring. Push() and Pop() move items with
+* atomic loads and stores only; the mutex and the condition variable are used only to park a thread
+* that finds the ring full or empty after a short spin, and the other side touches them only while
+* a thread is parked. Besides the item count, the queue can be bounded by the total byte size of
+* its items.
+*/
+template<typename T>
+class BoundedQueue
+{
+public:
+    BoundedQueue(int nMaxItems, size_t nMaxBytes = SIZE_MAX) : vItem(CheckMaxItems(nMaxItems)), vItemBytes(nMaxItems), nMaxBytes(nMaxBytes) {}
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    /**
+    *   @brief  Blocks while the queue is full. An item is always accepted by an empty queue,
+    *   whatever its size. Returns false if the queue has been closed.
+    */
+    bool Push(T &&item, size_t nItemBytes = 0)
+    {
+        // Only the producer writes nTail
+        const uint64_t iTail = nTail.load(std::memory_order_relaxed);
+        if (!CanPush(iTail, nItemBytes))
+        {
+            Wait([&] { return CanPush(iTail, nItemBytes) || bClosed.load(); });
+        }
+        if (bClosed.load())
+        {
+            return false;
+        }
+        vItem[iTail % vItem.size()] = std::move(item);
+        vItemBytes[iTail % vItem.size()] = nItemBytes;
+        nBytes.fetch_add(nItemBytes);
+        // Publishes the slot; sequentially consistent so that Notify() can't miss a consumer that
+        // is about to park
+        nTail.store(iTail + 1);
+        Notify();
+        return true;
+    }
+
+    /**
+    *   @brief  Blocks while the queue is empty. Returns false once the queue has been closed
+    *   and drained.
+    */
+    bool Pop(T *pItem)
+    {
+        // Only the consumer writes nHead
+        const uint64_t iHead = nHead.load(std::memory_order_relaxed);
+        if (nTail.load() == iHead)
+        {
+            Wait([&] { return nTail.load() != iHead || bClosed.load(); });
+            if (nTail.load() == iHead)
+            {
+                return false;
+            }
+        }
+        *pItem = std::move(vItem[iHead % vItem.size()]);
+        nBytes.fetch_sub(vItemBytes[iHead % vItem.size()]);
+        // Hands the slot back to the producer
+        nHead.store(iHead + 1);
+        Notify();
+        return true;
+    }
+
+    /**
+    *   @brief  Wakes up both sides. The producer stops accepting items; the consumer can still
+    *   drain what is queued.
+    */
+    void Close()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        bClosed = true;
+        cv.notify_all();
+    }
+
+    int GetDepth()
+    {
+        return (int)(nTail.load() - nHead.load());
+    }
+
+    size_t GetBytes()
+    {
+        return nBytes.load();
+    }
+
+private:
+    static int CheckMaxItems(int nMaxItems)
+    {
+        if (nMaxItems < 1)
+        {
+            throw std::invalid_argument("BoundedQueue needs room for at least one item");
+        }
+        return nMaxItems;
+    }
+
+    bool CanPush(uint64_t iTail, size_t nItemBytes)
+    {
+        uint64_t iHead = nHead.load();
+        return iTail == iHead || (iTail - iHead < vItem.size() && nBytes.load() + nItemBytes <= nMaxBytes);
+    }
+
+    /**
+    *   @brief  Spins briefly, as the other side usually frees or fills a slot within a few
+    *   microseconds, then parks until pred() holds. nWaiter is raised before pred() is checked
+    *   under the mutex, so a Notify() after a change that satisfies it always wakes this thread.
+    */
+    template<typename Pred>
+    void Wait(Pred pred)
+    {
+        for (int i = 0; i < 64; i++)
+        {
+            if (pred())
+            {
+                return;
+            }
+            std::this_thread::yield();
+        }
+        std::unique_lock<std::mutex> lock(mtx);
+        nWaiter++;
+        cv.wait(lock, pred);
+        nWaiter--;
+    }
+
+    void Notify()
+    {
+        if (nWaiter.load())
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            cv.notify_all();
+        }
+    }
+
+    std::vector<T> vItem;
+    std::vector<size_t> vItemBytes;
+    size_t nMaxBytes;
+    std::atomic<uint64_t> nHead{0}, nTail{0};
+    std::atomic<size_t> nBytes{0};
+    std::atomic<int> nWaiter{0};
+    std::atomic<bool> bClosed{false};
+    std::mutex mtx;
+    std::condition_variable cv;
+};
+
+#ifdef HOST_AVX2
+inline bool IsAvx2Supported() {
+#ifdef _MSC_VER
+    static const bool bAvx2 = [] {
+        int aInfo[4];
+        __cpuid(aInfo, 0);
+        if (aInfo[0] < 7) {
+            return false;
+        }
+        // AVX and OSXSAVE, and the OS has to preserve the YMM registers
+        __cpuid(aInfo, 1);
+        if ((aInfo[2] & 0x18000000) != 0x18000000 || (_xgetbv(0) & 6) != 6) {
+            return false;
+        }
+        __cpuidex(aInfo, 7, 0);
+        return (aInfo[1] & 0x20) != 0;
+    }();
+    return bAvx2;
+#else
+    return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+/**
+* @brief Loads eight 8- or 16-bit units as 32-bit values
+*/
+template<class T>
+HOST_AVX2_TARGET inline __m256i LoadUnitsAsInt32Avx2(const T *p) {
+    return sizeof(T) == 1 ? _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)p))
+        : _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)p));
+}
+
+/**
+* @brief Stores eight 32-bit values, which must be in range, as 8- or 16-bit units
+*/
+template<class T>
+HOST_AVX2_TARGET inline void StoreInt32AsUnitsAvx2(T *p, __m256i v) {
+    v = _mm256_packus_epi32(v, v);
+    if (sizeof(T) == 1) {
+        v = _mm256_packus_epi16(v, v);
+        _mm_storel_epi64((__m128i *)p, _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(v, _mm256_setr_epi32(0, 4, 0, 0, 0, 0, 0, 0))));
+    } else {
+        _mm_storeu_si128((__m128i *)p, _mm256_castsi256_si128(_mm256_permute4x64_epi64(v, _MM_SHUFFLE(3, 1, 2, 0))));
+    }
+}
+#endif
+
+/**
+* @brief Persistent worker pool behind ParallelFor(). There is one thread per CPU the process may
+* run on; the caller of Run() is one of them. On Linux the workers are pinned to those CPUs node by
+* node, so neighbouring bands share a NUMA node, and band i of every call lands on the same CPU,
+* which keeps the pages it touches local to that node from frame to frame.
+*/
+class HostWorkerPool {
+public:
+    static HostWorkerPool &Get() {
+        static HostWorkerPool pool;
+        return pool;
+    }
+    HostWorkerPool(const HostWorkerPool &) = delete;
+    HostWorkerPool &operator=(const HostWorkerPool &) = delete;
+    ~HostWorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            bStop = true;
+        }
+        cvStart.notify_all();
+        vWorker.clear();
+    }
+    int GetThreadCount() {
+        return (int)vWorker.size() + 1;
+    }
+    /**
+    *   @brief  Runs fn(i) for i in [0, nTask), task i on worker i and the last task on the calling
+    *   thread. Returns false, without running anything, if nTask exceeds the thread count, if
+    *   another thread is using the pool or if it's called from a worker.
+    */
+    bool Run(int nTask, const std::function<void(int)> &fn) {
+        if (nTask > GetThreadCount() || IsWorkerThread()) {
+            return false;
+        }
+        std::unique_lock<std::mutex> runLock(mtxRun, std::try_to_lock);
+        if (!runLock) {
+            return false;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            pFn = &fn;
+            nWorkerTask = nTask - 1;
+            nPending = nTask - 1;
+            iGeneration++;
+        }
+        cvStart.notify_all();
+        fn(nTask - 1);
+        std::unique_lock<std::mutex> lock(mtx);
+        cvDone.wait(lock, [this] { return nPending == 0; });
+        return true;
+    }
+
+private:
+    HostWorkerPool() {
+        std::vector<int> vCpu = GetCpus();
+        for (int i = 0; i + 1 < (int)vCpu.size(); i++) {
+            vWorker.push_back(NvThread(std::thread(&HostWorkerPool::WorkerProc, this, i, vCpu[i])));
+        }
+    }
+
+    static bool &IsWorkerThread() {
+        static thread_local bool bWorker = false;
+        return bWorker;
+    }
+
+    /**
+    *   @brief  CPUs to run on, grouped by NUMA node; -1 entries mean no pinning
+    */
+    static std::vector<int> GetCpus() {
+        std::vector<int> vCpu;
+#ifdef __linux__
+        cpu_set_t allowed;
+        CPU_ZERO(&allowed);
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+            cpu_set_t added;
+            CPU_ZERO(&added);
+            auto Add = [&](int iCpu) {
+                if (iCpu >= 0 && iCpu < CPU_SETSIZE && CPU_ISSET(iCpu, &allowed) && !CPU_ISSET(iCpu, &added)) {
+                    CPU_SET(iCpu, &added);
+                    vCpu.push_back(iCpu);
+                }
+            };
+            // cpulist holds ranges such as 0-15,32-47
+            for (int iNode = 0; iNode < 64; iNode++) {
+                std::ifstream cpuList("/sys/devices/system/node/node" + std::to_string(iNode) + "/cpulist");
+                int iFirst, iLast;
+                char c = ',';
+                while (c == ',' && cpuList >> iFirst) {
+                    iLast = iFirst;
+                    if (cpuList.get(c) && c == '-') {
+                        cpuList >> iLast;
+                        cpuList.get(c);
+                    }
+                    for (int iCpu = iFirst; iCpu <= iLast; iCpu++) {
+                        Add(iCpu);
+                    }
+                }
+            }
+            // Without NUMA information in sysfs, take the CPUs in order
+            for (int iCpu = 0; iCpu < CPU_SETSIZE; iCpu++) {
+                Add(iCpu);
+            }
+        }
+#endif
+        if (vCpu.empty()) {
+            vCpu.assign((std::max)(std::thread::hardware_concurrency(), 1u), -1);
+        }
+        return vCpu;
+    }
+
+    void WorkerProc(int iWorker, int iCpu) {
+        IsWorkerThread() = true;
+#ifdef __linux__
+        if (iCpu >= 0) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(iCpu, &cpus);
+            sched_setaffinity(0, sizeof(cpus), &cpus);
+        }
+#endif
+        uint64_t iSeen = 0;
+        std::unique_lock<std::mutex> lock(mtx);
+        for (;;) {
+            cvStart.wait(lock, [&] { return bStop || iGeneration != iSeen; });
+            if (bStop) {
+                return;
+            }
+            iSeen = iGeneration;
+            if (iWorker >= nWorkerTask) {
+                continue;
+            }
+            const std::function<void(int)> *pTask = pFn;
+            lock.unlock();
+            (*pTask)(iWorker);
+            lock.lock();
+            if (--nPending == 0) {
+                cvDone.notify_one();
+            }
+        }
+    }
+
+    std::vector<NvThread> vWorker;
+    // mtxRun admits one caller at a time; mtx guards the job below
+    std::mutex mtxRun, mtx;
+    std::condition_variable cvStart, cvDone;
+    const std::function<void(int)> *pFn = NULL;
+    int nWorkerTask = 0, nPending = 0;
+    uint64_t iGeneration = 0;
+    bool bStop = false;
+};
+
+/**
+* @brief Smallest number of rows of nPitch bytes that spans whole cache lines; bands of rows
+* aligned to it don't write to a cache line another band writes to.
+*/
+inline int GetRowBandAlignment(int nPitch) {
+    int a = 64, b = nPitch > 0 ? nPitch : 64;
+    while (b) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return 64 / a;
+}
+
+/**
+* @brief Splits [0, n) into contiguous bands, one per thread of HostWorkerPool, and runs
+* fn(iBegin, iEnd) on each. Bands have at least nMinBand items, so small jobs stay on the calling
+* thread, and start at multiples of nAlign (see GetRowBandAlignment()). If the pool is busy, for
+* example with a nested call, everything runs on the calling thread.
+*/
+inline void ParallelFor(int n, const std::function<void(int, int)> &fn, int nMinBand = 8, int nAlign = 1) {
+    if (n <= 0) {
+        return;
+    }
+    HostWorkerPool &pool = HostWorkerPool::Get();
+    nAlign = (std::max)(nAlign, 1);
+    int nBand = (std::min)(pool.GetThreadCount(), n / (std::max)((std::max)(nMinBand, nAlign), 1));
+    auto Boundary = [n, nBand, nAlign](int i) {
+        if (i >= nBand) {
+            return n;
+        }
+        int iBoundary = (int)((int64_t)n * i / nBand);
+        return iBoundary - iBoundary % nAlign;
+    };
+    if (nBand <= 1 || !pool.Run(nBand, [&](int i) {
+        int iBegin = Boundary(i), iEnd = Boundary(i + 1);
+        if (iBegin < iEnd) {
+            fn(iBegin, iEnd);
+        }
+    })) {
+        fn(0, n);
+    }
+}
+
 #ifndef _WIN32
 #define _stricmp strcasecmp
 #endif
 
-class BufferedFileReader {
+/**
+* @brief Read-only memory mapping of a whole file. Sizes are 64-bit, so files larger than 4 GB
+* can be mapped on 64-bit hosts.
+*/
+class MappedFile {
 public:
-    BufferedFileReader(const char *szFileName, bool bPartial = false) {
+    MappedFile(const char *szFileName) {
+#ifdef _WIN32
+        hFile = CreateFileA(szFileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+        if (hFile == INVALID_HANDLE_VALUE) {
+            LOG(ERROR) << "Unable to open file: " << szFileName;
+            return;
+        }
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(hFile, &size) || !size.QuadPart) {
+            return;
+        }
+        hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (!hMapping) {
+            LOG(ERROR) << "Unable to map file: " << szFileName;
+            return;
+        }
+        pData = (uint8_t *)MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+        if (!pData) {
+            LOG(ERROR) << "Unable to map file: " << szFileName;
+            return;
+        }
+        nSize = size.QuadPart;
+#else
+        fd = open(szFileName, O_RDONLY);
+        if (fd < 0) {
+            LOG(ERROR) << "Unable to open file: " << szFileName;
+            return;
+        }
         struct stat st;
-
-        if (stat(szFileName, &st) != 0) {
+        if (fstat(fd, &st) != 0 || !st.st_size) {
+            return;
+        }
+        void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+            LOG(ERROR) << "Unable to map file: " << szFileName;
             return;
         }
-        
+        pData = (uint8_t *)p;
         nSize = st.st_size;
-        while (nSize) {
-            try {
-                pBuf = new uint8_t[nSize];
-                if (nSize != st.st_size) {
-                    LOG(WARNING) << "File is too large - only " << std::setprecision(4) << 100.0 * nSize / (uint32_t)st.st_size << "% is loaded"; 
+#endif
+    }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() {
+#ifdef _WIN32
+        if (pData) {
+            UnmapViewOfFile(pData);
+        }
+        if (hMapping) {
+            CloseHandle(hMapping);
+        }
+        if (hFile != INVALID_HANDLE_VALUE) {
+            CloseHandle(hFile);
+        }
+#else
+        if (pData) {
+            munmap(pData, nSize);
+        }
+        if (fd >= 0) {
+            close(fd);
+        }
+#endif
+    }
+    const uint8_t *GetData() {
+        return pData;
+    }
+    uint64_t GetSize() {
+        return nSize;
+    }
+    /**
+    *   @brief  Access pattern hints for the page cache. They are no-ops on Windows, where the
+    *   cache manager detects sequential access by itself.
+    */
+    void AdviseSequential() {
+        Advise(0, nSize, SEQUENTIAL);
+    }
+    void WillNeed(uint64_t nOffset, uint64_t nLength) {
+        Advise(nOffset, nLength, WILL_NEED);
+    }
+    void DontNeed(uint64_t nOffset, uint64_t nLength) {
+        Advise(nOffset, nLength, DONT_NEED);
+    }
+    /**
+    *   @brief  Asks for transparent huge pages to back the mapping, which cuts page faults and
+    *   TLB misses on multi-GB inputs. Ignored by kernels that don't support it for files.
+    */
+    void AdviseHugePage() {
+        Advise(0, nSize, HUGE_PAGE);
+    }
+
+private:
+    enum Advice {
+        SEQUENTIAL,
+        WILL_NEED,
+        DONT_NEED,
+        HUGE_PAGE
+    };
+
+    void Advise(uint64_t nOffset, uint64_t nLength, Advice eAdvice) {
+        if (!pData || nOffset >= nSize) {
+            return;
+        }
+        nLength = std::min(nLength, nSize - nOffset);
+#ifndef _WIN32
+        // madvise() wants a page-aligned start
+        uint64_t nPageMask = (uint64_t)sysconf(_SC_PAGESIZE) - 1;
+        nLength += nOffset & nPageMask;
+        nOffset &= ~nPageMask;
+#ifdef MADV_HUGEPAGE
+        const int nHugePage = MADV_HUGEPAGE;
+#else
+        const int nHugePage = -1;
+#endif
+        const int aAdvice[] = {MADV_SEQUENTIAL, MADV_WILLNEED, MADV_DONTNEED, nHugePage};
+        if (aAdvice[eAdvice] >= 0) {
+            madvise(pData + nOffset, nLength, aAdvice[eAdvice]);
+        }
+#endif
+    }
+
+    uint8_t *pData = NULL;
+    uint64_t nSize = 0;
+#ifdef _WIN32
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+    HANDLE hMapping = NULL;
+#else
+    int fd = -1;
+#endif
+};
+
+/**
+* @brief Stream parameters of a YUV4MPEG2 (Y4M) file. Y4M frames are planar, each one preceded by a
+* FRAME line; samples deeper than 8 bits take 2 bytes, little endian.
+*/
+struct Y4mInfo {
+    int nWidth = 0, nHeight = 0;
+    int nFrameRateNum = 25, nFrameRateDen = 1;
+    // 420, 422, 444, or 400 for luma only
+    int nChroma = 420;
+    int nBitDepth = 8;
+
+    /**
+    *   @brief  Parses the stream header at the start of pData. Returns the length of the header
+    *   including its line feed, or 0 if pData doesn't start with a valid Y4M header.
+    */
+    int Parse(const uint8_t *pData, size_t nSize) {
+        const char szMagic[] = "YUV4MPEG2 ";
+        const uint8_t *pEnd = (const uint8_t *)memchr(pData, '\n', (std::min)(nSize, (size_t)1024));
+        if (!pEnd || nSize < sizeof(szMagic) - 1 || memcmp(pData, szMagic, sizeof(szMagic) - 1)) {
+            return 0;
+        }
+        std::istringstream header(std::string((const char *)pData + sizeof(szMagic) - 1, (const char *)pEnd));
+        std::string token;
+        while (header >> token) {
+            const char *sz = token.c_str() + 1;
+            switch (token[0]) {
+            case 'W': nWidth = atoi(sz); break;
+            case 'H': nHeight = atoi(sz); break;
+            case 'F':
+                if (sscanf(sz, "%d:%d", &nFrameRateNum, &nFrameRateDen) != 2 || nFrameRateNum <= 0 || nFrameRateDen <= 0) {
+                    return 0;
                 }
                 break;
-            } catch(std::bad_alloc) {
-                if (!bPartial) {
-                    LOG(ERROR) << "Failed to allocate memory in BufferedReader";
-                    return;
+            case 'C':
+                if (!strncmp(sz, "mono", 4)) {
+                    nChroma = 400;
+                    nBitDepth = sz[4] ? atoi(sz + 4) : 8;
+                } else {
+                    nChroma = atoi(sz);
+                    const char *szDepth = strchr(sz, 'p');
+                    nBitDepth = szDepth && isdigit((unsigned char)szDepth[1]) ? atoi(szDepth + 1) : 8;
+                }
+                if ((nChroma != 420 && nChroma != 422 && nChroma != 444 && nChroma != 400) || nBitDepth < 8 || nBitDepth > 16) {
+                    LOG(ERROR) << "Unsupported Y4M color space: " << sz;
+                    return 0;
                 }
-                nSize = (uint32_t)(nSize * 0.9);
+                break;
             }
         }
+        return nWidth > 0 && nHeight > 0 ? (int)(pEnd - pData + 1) : 0;
+    }
+    /**
+    *   @brief  Reads the stream header of the file. Returns false if it isn't a Y4M file.
+    */
+    bool ParseFile(const char *szFilePath) {
+        uint8_t aHeader[1024];
+        std::ifstream fpIn(szFilePath, std::ifstream::in | std::ifstream::binary);
+        return Parse(aHeader, (size_t)fpIn.read(reinterpret_cast<char *>(aHeader), sizeof(aHeader)).gcount()) > 0;
+    }
+    std::string GetHeader() const {
+        std::ostringstream header;
+        header << "YUV4MPEG2 W" << nWidth << " H" << nHeight << " F" << nFrameRateNum << ":" << nFrameRateDen << " Ip A1:1 C";
+        if (nChroma == 400) {
+            header << "mono";
+        } else {
+            header << nChroma << (nBitDepth == 8 && nChroma == 420 ? "jpeg" : "");
+        }
+        if (nBitDepth > 8) {
+            header << (nChroma == 400 ? "" : "p") << nBitDepth;
+        }
+        header << "\n";
+        return header.str();
+    }
+    uint64_t GetFrameSize() const {
+        uint64_t nChromaWidth = nChroma == 444 ? nWidth : (nWidth + 1) / 2;
+        uint64_t nChromaHeight = nChroma == 420 ? (nHeight + 1) / 2 : nHeight;
+        uint64_t nSamples = (uint64_t)nWidth * nHeight + (nChroma == 400 ? 0 : 2 * nChromaWidth * nChromaHeight);
+        return nSamples * (nBitDepth > 8 ? 2 : 1);
+    }
+};
 
-        std::ifstream fpIn(szFileName, std::ifstream::in | std::ifstream::binary);
-        if (!fpIn)
-        {
-            LOG(ERROR) << "Unable to open input file: " << szFileName;
-            return;
+#ifdef _NV_ENCODEAPI_H_
+/**
+* @brief Picks the encoder input format that takes the frames of a Y4M file as they are.
+* 16-bit 4:4:4 is accepted as YUV444_10BIT, which uses the upper 10 bits of each sample.
+*/
+inline bool GetY4mEncodeFormat(const Y4mInfo &info, NV_ENC_BUFFER_FORMAT *peFormat) {
+    if (info.nChroma == 420 && info.nBitDepth == 8) {
+        *peFormat = NV_ENC_BUFFER_FORMAT_IYUV;
+    } else if (info.nChroma == 444 && info.nBitDepth == 8) {
+        *peFormat = NV_ENC_BUFFER_FORMAT_YUV444;
+    } else if (info.nChroma == 444 && info.nBitDepth == 16) {
+        *peFormat = NV_ENC_BUFFER_FORMAT_YUV444_10BIT;
+    } else {
+        return false;
+    }
+    return true;
+}
+#endif
+
+/**
+* @brief Gives access to a whole raw file through a read-only memory mapping. Pages are read on
+* first access with sequential read-ahead, so opening takes the same time whatever the file size,
+* and files over 4 GB are fully accessible. Once the frame layout is set, frames can be visited as
+* views into the mapping without any copy. Y4M files are recognized by their header; frame views
+* skip the Y4M headers, while GetBuffer() still returns the file as it is.
+*/
+class BufferedFileReader {
+public:
+    /**
+    *   @brief  A frame inside the mapping. The luma plane starts at pData with nPitch bytes per
+    *   row (0 for rows packed at the frame width); the chroma planes follow as stored in the file.
+    */
+    struct FrameView {
+        const uint8_t *pData;
+        uint32_t nPitch;
+    };
+
+    class FrameIterator {
+    public:
+        FrameIterator(BufferedFileReader *pReader, uint64_t iFrame) : pReader(pReader), iFrame(iFrame) {}
+        FrameView operator*() {
+            return pReader->GetFrame(iFrame);
+        }
+        FrameIterator &operator++() {
+            iFrame++;
+            return *this;
+        }
+        bool operator!=(const FrameIterator &other) const {
+            return iFrame != other.iFrame;
         }
 
-        std::streamsize nRead = fpIn.read(reinterpret_cast<char*>(pBuf), nSize).gcount();
-        fpIn.close();
+    private:
+        BufferedFileReader *pReader;
+        uint64_t iFrame;
+    };
 
-        assert(nRead == nSize);
-    }
-    ~BufferedFileReader() {
-        if (pBuf) {
-            delete[] pBuf;
+    BufferedFileReader(const char *szFileName) : file(szFileName) {
+        file.AdviseHugePage();
+        file.AdviseSequential();
+        if (file.GetData()) {
+            nDataOffset = y4mInfo.Parse(file.GetData(), file.GetSize());
         }
     }
-    bool GetBuffer(uint8_t **ppBuf, uint32_t *pnSize) {
-        if (!pBuf) {
+    /**
+    *   @brief  Returns the stream parameters if the file is a Y4M file, NULL otherwise.
+    */
+    const Y4mInfo *GetY4mInfo() {
+        return nDataOffset ? &y4mInfo : NULL;
+    }
+    bool GetBuffer(const uint8_t **ppBuf, uint64_t *pnSize) {
+        if (!file.GetData()) {
             return false;
         }
 
-        *ppBuf = pBuf;
-        *pnSize = nSize;
+        *ppBuf = file.GetData();
+        *pnSize = file.GetSize();
         return true;
     }
+    /**
+    *   @brief  Sets the size of one frame in the file and the luma pitch reported by frame views.
+    */
+    void SetFrameLayout(uint64_t nFrameSize, uint32_t nPitch = 0) {
+        this->nFrameSize = nFrameSize;
+        this->nPitch = nPitch;
+        nFrameHeader = 0;
+        bFrameTable = false;
+        vFrameOffset.clear();
+        if (!nDataOffset || !nFrameSize) {
+            return;
+        }
+
+        // Y4M frame lines are normally bare, which puts the frames at a fixed stride; check the
+        // first and the last one
+        nFrameHeader = GetFrameHeaderSize(nDataOffset);
+        uint64_t nFrame = (file.GetSize() - nDataOffset) / (nFrameHeader + nFrameSize);
+        if (nFrameHeader && (!nFrame || GetFrameHeaderSize(nDataOffset + (nFrame - 1) * (nFrameHeader + nFrameSize)) == nFrameHeader)) {
+            return;
+        }
+        // Frame lines with parameters: locate every frame once
+        bFrameTable = true;
+        for (uint64_t nOffset = nDataOffset, n; (n = GetFrameHeaderSize(nOffset)) && nOffset + n + nFrameSize <= file.GetSize(); nOffset += n + nFrameSize) {
+            vFrameOffset.push_back(nOffset + n);
+        }
+    }
+    uint64_t GetFrameCount() {
+        if (bFrameTable) {
+            return vFrameOffset.size();
+        }
+        return nFrameSize ? (file.GetSize() - nDataOffset) / (nFrameHeader + nFrameSize) : 0;
+    }
+    /**
+    *   @brief  Returns the view of frame iFrame (which must be below GetFrameCount()) and starts
+    *   reading the next one in the background.
+    */
+    FrameView GetFrame(uint64_t iFrame) {
+        uint64_t nOffset = bFrameTable ? vFrameOffset[iFrame] : nDataOffset + iFrame * (nFrameHeader + nFrameSize) + nFrameHeader;
+        file.WillNeed(nOffset + nFrameSize, nFrameHeader + nFrameSize);
+        FrameView view = {file.GetData() + nOffset, nPitch};
+        return view;
+    }
+    FrameIterator begin() {
+        return FrameIterator(this, 0);
+    }
+    FrameIterator end() {
+        return FrameIterator(this, GetFrameCount());
+    }
 
 private:
-    uint8_t *pBuf = NULL;
-    uint32_t nSize = 0;
+    // Length of the Y4M frame line at nOffset, or 0 if there is none
+    uint64_t GetFrameHeaderSize(uint64_t nOffset) {
+        const char szFrame[] = "FRAME";
+        if (nOffset + sizeof(szFrame) > file.GetSize() || memcmp(file.GetData() + nOffset, szFrame, sizeof(szFrame) - 1)) {
+            return 0;
+        }
+        const uint8_t *pEnd = (const uint8_t *)memchr(file.GetData() + nOffset, '\n', (size_t)(std::min)((uint64_t)256, file.GetSize() - nOffset));
+        return pEnd ? pEnd - (file.GetData() + nOffset) + 1 : 0;
+    }
+
+    MappedFile file;
+    uint64_t nFrameSize = 0;
+    uint32_t nPitch = 0;
+    // Y4M layout: stream header size, frame line size if constant, frame offsets otherwise
+    Y4mInfo y4mInfo;
+    uint64_t nDataOffset = 0, nFrameHeader = 0;
+    bool bFrameTable = false;
+    std::vector<uint64_t> vFrameOffset;
 };
 
+/**
+* @brief Row kernels for YuvConverter: split n interleaved UV pairs into separate U and V rows, and
+* merge them back. They process the row front to back, loading each block before storing it, so
+* pU may alias pUV in SplitUVRow and pV may alias the tail of pUV in MergeUVRow.
+*/
 template<typename T>
-class YuvConverter {
-public:
-    YuvConverter(int nWidth, int nHeight) : nWidth(nWidth), nHeight(nHeight) {
-        pQuad = new T[nWidth * nHeight / 4];
+inline void SplitUVRow(const T *pUV, T *pU, T *pV, int n) {
+    for (int i = 0; i < n; i++) {
+        pU[i] = pUV[2 * i];
+        pV[i] = pUV[2 * i + 1];
+    }
+}
+
+template<typename T>
+inline void MergeUVRow(const T *pU, const T *pV, T *pUV, int n) {
+    for (int i = 0; i < n; i++) {
+        T u = pU[i], v = pV[i];
+        pUV[2 * i] = u;
+        pUV[2 * i + 1] = v;
+    }
+}
+
+#ifdef HOST_AVX2
+HOST_AVX2_TARGET inline int SplitUVRowAvx2(const uint8_t *pUV, uint8_t *pU, uint8_t *pV, int n) {
+    int i = 0;
+    const __m256i mask = _mm256_set1_epi16(0xFF);
+    for (; i + 32 <= n; i += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(pUV + 2 * i)), b = _mm256_loadu_si256((const __m256i *)(pUV + 2 * i + 32));
+        __m256i u = _mm256_packus_epi16(_mm256_and_si256(a, mask), _mm256_and_si256(b, mask));
+        __m256i v = _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+        _mm256_storeu_si256((__m256i *)(pU + i), _mm256_permute4x64_epi64(u, _MM_SHUFFLE(3, 1, 2, 0)));
+        _mm256_storeu_si256((__m256i *)(pV + i), _mm256_permute4x64_epi64(v, _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+    return i;
+}
+
+HOST_AVX2_TARGET inline int SplitUVRowAvx2(const uint16_t *pUV, uint16_t *pU, uint16_t *pV, int n) {
+    int i = 0;
+    const __m256i mask = _mm256_set1_epi32(0xFFFF);
+    for (; i + 16 <= n; i += 16) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(pUV + 2 * i)), b = _mm256_loadu_si256((const __m256i *)(pUV + 2 * i + 16));
+        __m256i u = _mm256_packus_epi32(_mm256_and_si256(a, mask), _mm256_and_si256(b, mask));
+        __m256i v = _mm256_packus_epi32(_mm256_srli_epi32(a, 16), _mm256_srli_epi32(b, 16));
+        _mm256_storeu_si256((__m256i *)(pU + i), _mm256_permute4x64_epi64(u, _MM_SHUFFLE(3, 1, 2, 0)));
+        _mm256_storeu_si256((__m256i *)(pV + i), _mm256_permute4x64_epi64(v, _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+    return i;
+}
+
+HOST_AVX2_TARGET inline int MergeUVRowAvx2(const uint8_t *pU, const uint8_t *pV, uint8_t *pUV, int n) {
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i u = _mm256_loadu_si256((const __m256i *)(pU + i)), v = _mm256_loadu_si256((const __m256i *)(pV + i));
+        __m256i lo = _mm256_unpacklo_epi8(u, v), hi = _mm256_unpackhi_epi8(u, v);
+        _mm256_storeu_si256((__m256i *)(pUV + 2 * i), _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i *)(pUV + 2 * i + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    return i;
+}
+
+HOST_AVX2_TARGET inline int MergeUVRowAvx2(const uint16_t *pU, const uint16_t *pV, uint16_t *pUV, int n) {
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i u = _mm256_loadu_si256((const __m256i *)(pU + i)), v = _mm256_loadu_si256((const __m256i *)(pV + i));
+        __m256i lo = _mm256_unpacklo_epi16(u, v), hi = _mm256_unpackhi_epi16(u, v);
+        _mm256_storeu_si256((__m256i *)(pUV + 2 * i), _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256((__m256i *)(pUV + 2 * i + 16), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+    return i;
+}
+#endif
+
+inline void SplitUVRow(const uint8_t *pUV, uint8_t *pU, uint8_t *pV, int n) {
+    int i = 0;
+#ifdef HOST_AVX2
+    if (IsAvx2Supported()) {
+        i = SplitUVRowAvx2(pUV, pU, pV, n);
+    }
+#endif
+#if defined(YUV_CONVERTER_SSE2)
+    const __m128i mask = _mm_set1_epi16(0xFF);
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(pUV + 2 * i)), b = _mm_loadu_si128((const __m128i *)(pUV + 2 * i + 16));
+        __m128i u = _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask));
+        __m128i v = _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8));
+        _mm_storeu_si128((__m128i *)(pU + i), u);
+        _mm_storeu_si128((__m128i *)(pV + i), v);
+    }
+#elif defined(YUV_CONVERTER_NEON)
+    for (; i + 16 <= n; i += 16) {
+        uint8x16x2_t uv = vld2q_u8(pUV + 2 * i);
+        vst1q_u8(pU + i, uv.val[0]);
+        vst1q_u8(pV + i, uv.val[1]);
+    }
+#endif
+    SplitUVRow<uint8_t>(pUV + 2 * i, pU + i, pV + i, n - i);
+}
+
+inline void SplitUVRow(const uint16_t *pUV, uint16_t *pU, uint16_t *pV, int n) {
+    int i = 0;
+#ifdef HOST_AVX2
+    if (IsAvx2Supported()) {
+        i = SplitUVRowAvx2(pUV, pU, pV, n);
+    }
+#endif
+#if defined(YUV_CONVERTER_SSE2)
+    for (; i + 8 <= n; i += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(pUV + 2 * i)), b = _mm_loadu_si128((const __m128i *)(pUV + 2 * i + 8));
+        // SSE2 has no unsigned 32->16 pack; sign-extending each half keeps the signed pack exact
+        __m128i u = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16), _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+        __m128i v = _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16));
+        _mm_storeu_si128((__m128i *)(pU + i), u);
+        _mm_storeu_si128((__m128i *)(pV + i), v);
+    }
+#elif defined(YUV_CONVERTER_NEON)
+    for (; i + 8 <= n; i += 8) {
+        uint16x8x2_t uv = vld2q_u16(pUV + 2 * i);
+        vst1q_u16(pU + i, uv.val[0]);
+        vst1q_u16(pV + i, uv.val[1]);
+    }
+#endif
+    SplitUVRow<uint16_t>(pUV + 2 * i, pU + i, pV + i, n - i);
+}
+
+inline void MergeUVRow(const uint8_t *pU, const uint8_t *pV, uint8_t *pUV, int n) {
+    int i = 0;
+#ifdef HOST_AVX2
+    if (IsAvx2Supported()) {
+        i = MergeUVRowAvx2(pU, pV, pUV, n);
+    }
+#endif
+#if defined(YUV_CONVERTER_SSE2)
+    for (; i + 16 <= n; i += 16) {
+        __m128i u = _mm_loadu_si128((const __m128i *)(pU + i)), v = _mm_loadu_si128((const __m128i *)(pV + i));
+        _mm_storeu_si128((__m128i *)(pUV + 2 * i), _mm_unpacklo_epi8(u, v));
+        _mm_storeu_si128((__m128i *)(pUV + 2 * i + 16), _mm_unpackhi_epi8(u, v));
     }
-    ~YuvConverter() {
-        delete pQuad;
+#elif defined(YUV_CONVERTER_NEON)
+    for (; i + 16 <= n; i += 16) {
+        uint8x16x2_t uv;
+        uv.val[0] = vld1q_u8(pU + i);
+        uv.val[1] = vld1q_u8(pV + i);
+        vst2q_u8(pUV + 2 * i, uv);
     }
+#endif
+    MergeUVRow<uint8_t>(pU + i, pV + i, pUV + 2 * i, n - i);
+}
+
+inline void MergeUVRow(const uint16_t *pU, const uint16_t *pV, uint16_t *pUV, int n) {
+    int i = 0;
+#ifdef HOST_AVX2
+    if (IsAvx2Supported()) {
+        i = MergeUVRowAvx2(pU, pV, pUV, n);
+    }
+#endif
+#if defined(YUV_CONVERTER_SSE2)
+    for (; i + 8 <= n; i += 8) {
+        __m128i u = _mm_loadu_si128((const __m128i *)(pU + i)), v = _mm_loadu_si128((const __m128i *)(pV + i));
+        _mm_storeu_si128((__m128i *)(pUV + 2 * i), _mm_unpacklo_epi16(u, v));
+        _mm_storeu_si128((__m128i *)(pUV + 2 * i + 8), _mm_unpackhi_epi16(u, v));
+    }
+#elif defined(YUV_CONVERTER_NEON)
+    for (; i + 8 <= n; i += 8) {
+        uint16x8x2_t uv;
+        uv.val[0] = vld1q_u16(pU + i);
+        uv.val[1] = vld1q_u16(pV + i);
+        vst2q_u16(pUV + 2 * i, uv);
+    }
+#endif
+    MergeUVRow<uint16_t>(pU + i, pV + i, pUV + 2 * i, n - i);
+}
+
+/**
+* @brief Converts 4:2:0 frames between the semi-planar layout (NV12, P016) and the planar one (IYUV,
+* YUV420P16). Pitches are in samples; 0 means the frame is packed. Planar chroma uses half the luma
+* pitch. Rows are split into bands over ParallelFor(). Bands of an in-place conversion would
+* overwrite rows other bands haven't read yet, so the chroma goes through a scratch copy of both
+* planes, which is kept per thread; constructing a converter per frame costs nothing. The
+* out-of-place conversions touch each sample once and need no scratch.
+*/
+template<typename T>
+class YuvConverter {
+public:
+    YuvConverter(int nWidth, int nHeight) : nWidth(nWidth), nHeight(nHeight) {}
     void PlanarToUVInterleaved(T *pFrame, int nPitch = 0) {
         if (nPitch == 0) {
             nPitch = nWidth;
         }
-        T *puv = pFrame + nPitch * nHeight;
-        if (nPitch == nWidth) {
-            memcpy(pQuad, puv, nWidth * nHeight / 4 * sizeof(T));
-        } else {
-            for (int i = 0; i < nHeight / 2; i++) {
-                memcpy(pQuad + nWidth / 2 * i, puv + nPitch / 2 * i, nWidth / 2 * sizeof(T));
-            }
-        }
-        T *pv = puv + (nPitch / 2) * (nHeight / 2);
-        for (int y = 0; y < nHeight / 2; y++) {
-            for (int x = 0; x < nWidth / 2; x++) {
-                puv[y * nPitch + x * 2] = pQuad[y * nWidth / 2 + x];
-                puv[y * nPitch + x * 2 + 1] = pv[y * nPitch / 2 + x];
-            }
-        }
+        T *puv = pFrame + nPitch * nHeight, *pu = GetScratch();
+        const T *pv = pu + (nWidth / 2) * (nHeight / 2);
+        // U and V planes follow each other, in the frame and in the scratch
+        CopyRows(puv, nPitch / 2, pu, nWidth / 2, nWidth / 2, nHeight / 2 * 2);
+        MergeUVRows(pu, pv, nWidth / 2, puv, nPitch);
     }
     void UVInterleavedToPlanar(T *pFrame, int nPitch = 0) {
         if (nPitch == 0) {
             nPitch = nWidth;
         }
-        T *puv = pFrame + nPitch * nHeight, 
-            *pu = puv, 
-            *pv = puv + nPitch * nHeight / 4;
-        for (int y = 0; y < nHeight / 2; y++) {
-            for (int x = 0; x < nWidth / 2; x++) {
-                pu[y * nPitch / 2 + x] = puv[y * nPitch + x * 2];
-                pQuad[y * nWidth / 2 + x] = puv[y * nPitch + x * 2 + 1];
-            }
+        T *puv = pFrame + nPitch * nHeight, *pu = GetScratch(), *pv = pu + (nWidth / 2) * (nHeight / 2);
+        SplitUVRows(puv, nPitch, pu, pv, nWidth / 2);
+        CopyRows(pu, nWidth / 2, puv, nPitch / 2, nWidth / 2, nHeight / 2 * 2);
+    }
+    /**
+    *   @brief  Out-of-place variants; luma is copied along with the chroma conversion.
+    */
+    void PlanarToUVInterleaved(const T *pSrcFrame, int nSrcPitch, T *pDstFrame, int nDstPitch) {
+        if (nSrcPitch == 0) {
+            nSrcPitch = nWidth;
         }
-        if (nPitch == nWidth) {
-            memcpy(pv, pQuad, nWidth * nHeight / 4 * sizeof(T));
-        } else {
-            for (int i = 0; i < nHeight / 2; i++) {
-                memcpy(pv + nPitch / 2 * i, pQuad + nWidth / 2 * i, nWidth / 2 * sizeof(T));
-            }
+        if (nDstPitch == 0) {
+            nDstPitch = nWidth;
         }
+        CopyRows(pSrcFrame, nSrcPitch, pDstFrame, nDstPitch, nWidth, nHeight);
+        const T *pu = pSrcFrame + nSrcPitch * nHeight, *pv = pu + (nSrcPitch / 2) * (nHeight / 2);
+        MergeUVRows(pu, pv, nSrcPitch / 2, pDstFrame + nDstPitch * nHeight, nDstPitch);
+    }
+    void UVInterleavedToPlanar(const T *pSrcFrame, int nSrcPitch, T *pDstFrame, int nDstPitch) {
+        if (nSrcPitch == 0) {
+            nSrcPitch = nWidth;
+        }
+        if (nDstPitch == 0) {
+            nDstPitch = nWidth;
+        }
+        CopyRows(pSrcFrame, nSrcPitch, pDstFrame, nDstPitch, nWidth, nHeight);
+        T *pu = pDstFrame + nDstPitch * nHeight, *pv = pu + (nDstPitch / 2) * (nHeight / 2);
+        SplitUVRows(pSrcFrame + nSrcPitch * nHeight, nSrcPitch, pu, pv, nDstPitch / 2);
     }
 
 private:
-    T *pQuad;
+    T *GetScratch() {
+        static thread_local std::vector<T> vScratch;
+        if (vScratch.size() < (size_t)(nWidth / 2) * (nHeight / 2) * 2) {
+            vScratch.resize((size_t)(nWidth / 2) * (nHeight / 2) * 2);
+        }
+        return vScratch.data();
+    }
+    void MergeUVRows(const T *pu, const T *pv, int nPlanarPitch, T *puv, int nPitch) {
+        ParallelFor(nHeight / 2, [&](int iBegin, int iEnd) {
+            for (int y = iBegin; y < iEnd; y++) {
+                MergeUVRow(pu + (size_t)y * nPlanarPitch, pv + (size_t)y * nPlanarPitch, puv + (size_t)y * nPitch, nWidth / 2);
+            }
+        }, 8, GetRowBandAlignment(nPitch * (int)sizeof(T)));
+    }
+    void SplitUVRows(const T *puv, int nPitch, T *pu, T *pv, int nPlanarPitch) {
+        ParallelFor(nHeight / 2, [&](int iBegin, int iEnd) {
+            for (int y = iBegin; y < iEnd; y++) {
+                SplitUVRow(puv + (size_t)y * nPitch, pu + (size_t)y * nPlanarPitch, pv + (size_t)y * nPlanarPitch, nWidth / 2);
+            }
+        }, 8, GetRowBandAlignment(nPlanarPitch * (int)sizeof(T)));
+    }
+    static void CopyRows(const T *pSrc, int nSrcPitch, T *pDst, int nDstPitch, int nRowWidth, int nRows) {
+        ParallelFor(nRows, [&](int iBegin, int iEnd) {
+            if (nSrcPitch == nRowWidth && nDstPitch == nRowWidth) {
+                memcpy(pDst + (size_t)nDstPitch * iBegin, pSrc + (size_t)nSrcPitch * iBegin, (size_t)nRowWidth * (iEnd - iBegin) * sizeof(T));
+                return;
+            }
+            for (int i = iBegin; i < iEnd; i++) {
+                memcpy(pDst + (size_t)nDstPitch * i, pSrc + (size_t)nSrcPitch * i, nRowWidth * sizeof(T));
+            }
+        }, 16, GetRowBandAlignment(nDstPitch * (int)sizeof(T)));
+    }
+
     int nWidth, nHeight;
 };
 
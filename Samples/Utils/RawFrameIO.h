@@ -0,0 +1,337 @@
+/*
+* Copyright 2017-2018 NVIDIA Corporation.  All rights reserved.
+*
+* Please refer to the NVIDIA end user license agreement (EULA) associated
+* with this source code for terms and conditions that govern your use of
+* this software. Any use, reproduction, disclosure, or distribution of
+* this software and related documentation outside the terms of the EULA
+* is strictly prohibited.
+*
+*/
+#pragma once
+
+#include <climits>
+#include <fstream>
+#include <functional>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <malloc.h>
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <stdlib.h>
+#include <unistd.h>
+#endif
+#include "NvCodecUtils.h"
+
+inline uint8_t *AllocAlignedFrame(size_t nSize, size_t nAlignment = 4096) {
+#ifdef _WIN32
+    return (uint8_t *)_aligned_malloc(nSize, nAlignment);
+#else
+    void *p = NULL;
+    return posix_memalign(&p, nAlignment, nSize) ? NULL : (uint8_t *)p;
+#endif
+}
+
+inline void FreeAlignedFrame(uint8_t *p) {
+#ifdef _WIN32
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+}
+
+/**
+* @brief Reads fixed-size raw frames ahead of the consumer. A background thread fills a pool of
+* page-aligned buffers, nReadAhead frames in advance; each buffer goes back to the pool when the
+* consumer asks for the next frame, so no allocation happens after construction. A trailing
+* partial frame is dropped. Y4M input is recognized by its header, and the Y4M headers are
+* skipped.
+*/
+class RawFrameReader {
+public:
+    RawFrameReader(const char *szFilePath, int nFrameSize, int nReadAhead = 4) : fpIn(szFilePath, std::ifstream::in | std::ifstream::binary),
+        nFrameSize(nFrameSize), freeQueue(nReadAhead + 1), readyQueue(nReadAhead + 1) {
+        if (!fpIn) {
+            LOG(ERROR) << "Unable to open input file: " << szFilePath;
+            readyQueue.Close();
+            return;
+        }
+        uint8_t aHeader[1024];
+        int nHeader = y4mInfo.Parse(aHeader, (size_t)fpIn.read(reinterpret_cast<char *>(aHeader), sizeof(aHeader)).gcount());
+        bY4m = nHeader > 0;
+        fpIn.clear();
+        fpIn.seekg(nHeader);
+        for (int i = 0; i < nReadAhead + 1; i++) {
+            uint8_t *pFrame = AllocAlignedFrame(nFrameSize);
+            if (!pFrame) {
+                LOG(ERROR) << "Failed to allocate frame buffer";
+                break;
+            }
+            vpFrame.push_back(pFrame);
+            freeQueue.Push(std::move(pFrame));
+        }
+        if (vpFrame.empty()) {
+            readyQueue.Close();
+            return;
+        }
+        readThread = NvThread(std::thread(&RawFrameReader::ReadProc, this));
+    }
+    RawFrameReader(const RawFrameReader&) = delete;
+    RawFrameReader& operator=(const RawFrameReader&) = delete;
+    ~RawFrameReader() {
+        readyQueue.Close();
+        freeQueue.Close();
+        readThread.join();
+        for (uint8_t *pFrame : vpFrame) {
+            FreeAlignedFrame(pFrame);
+        }
+    }
+    bool IsOpen() {
+        return !vpFrame.empty();
+    }
+    /**
+    *   @brief  Returns the stream parameters if the input is a Y4M file, NULL otherwise.
+    */
+    const Y4mInfo *GetY4mInfo() {
+        return bY4m ? &y4mInfo : NULL;
+    }
+    /**
+    *   @brief  Returns the next frame, or NULL at the end of the file. The frame stays valid until
+    *   the next call.
+    */
+    uint8_t *ReadFrame() {
+        if (pCurrentFrame) {
+            freeQueue.Push(std::move(pCurrentFrame));
+            pCurrentFrame = NULL;
+        }
+        if (!readyQueue.Pop(&pCurrentFrame)) {
+            pCurrentFrame = NULL;
+        }
+        return pCurrentFrame;
+    }
+    /**
+    *   @brief  Number of frames read ahead and waiting for the consumer
+    */
+    int GetReadyFrameCount() {
+        return readyQueue.GetDepth();
+    }
+
+private:
+    void ReadProc() {
+        uint8_t *pFrame = NULL;
+        std::string frameLine;
+        while (freeQueue.Pop(&pFrame)) {
+            if (bY4m && (!std::getline(fpIn, frameLine) || frameLine.compare(0, 5, "FRAME"))) {
+                break;
+            }
+            if (fpIn.read(reinterpret_cast<char *>(pFrame), nFrameSize).gcount() != nFrameSize
+                || !readyQueue.Push(std::move(pFrame))) {
+                break;
+            }
+        }
+        readyQueue.Close();
+    }
+
+    std::ifstream fpIn;
+    int nFrameSize;
+    Y4mInfo y4mInfo;
+    bool bY4m = false;
+    std::vector<uint8_t *> vpFrame;
+    BoundedQueue<uint8_t *> freeQueue, readyQueue;
+    uint8_t *pCurrentFrame = NULL;
+    NvThread readThread;
+};
+
+/**
+* @brief Writes frames to a file on a background thread. The writer takes ownership of each
+* submitted frame and hands it back through its release callback once the data is out (for example
+* NvDecoder::UnlockFrame() for frames from DecodeLockFrame()). Frames are coalesced into large
+* writes through a page-aligned staging buffer, which also lets the file be opened with O_DIRECT
+* (Linux only) so that exported data doesn't pollute the page cache. Submission blocks once
+* nMaxQueuedFrames frames are pending, which bounds the memory held by the writer.
+*/
+class AsyncFrameWriter {
+public:
+    AsyncFrameWriter(const char *szFilePath, bool bDirect = false, int nMaxQueuedFrames = 16, int nCoalesceBytes = 8 * 1024 * 1024)
+        : bDirect(bDirect), queue(nMaxQueuedFrames) {
+#ifdef _WIN32
+        // Unbuffered I/O on Windows needs sector-aligned sizes for every write; not worth it here
+        this->bDirect = false;
+        fd = _open(szFilePath, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+        int flags = O_WRONLY | O_CREAT | O_TRUNC;
+#ifdef O_DIRECT
+        if (bDirect) {
+            flags |= O_DIRECT;
+        }
+#else
+        this->bDirect = false;
+#endif
+        fd = open(szFilePath, flags, 0644);
+        if (fd < 0 && bDirect) {
+            LOG(WARNING) << "Direct I/O isn't supported for " << szFilePath << "; using buffered writes";
+            this->bDirect = false;
+            fd = open(szFilePath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        }
+#endif
+        if (fd < 0) {
+            LOG(ERROR) << "Unable to open output file: " << szFilePath;
+            return;
+        }
+        nStagingSize = (std::max)(nCoalesceBytes, 1) + nAlignment - 1;
+        nStagingSize -= nStagingSize % nAlignment;
+        pStaging = AllocAlignedFrame(nStagingSize, nAlignment);
+        if (!pStaging) {
+            LOG(ERROR) << "Failed to allocate staging buffer";
+            return;
+        }
+        writeThread = NvThread(std::thread(&AsyncFrameWriter::WriteProc, this));
+    }
+    AsyncFrameWriter(const AsyncFrameWriter&) = delete;
+    AsyncFrameWriter& operator=(const AsyncFrameWriter&) = delete;
+    ~AsyncFrameWriter() {
+        Close();
+        if (pStaging) {
+            FreeAlignedFrame(pStaging);
+        }
+    }
+    /**
+    *   @brief  Writes out all pending frames and closes the file. Frames written afterwards are
+    *   released without being written.
+    */
+    void Close() {
+        queue.Close();
+        writeThread.join();
+        if (fd >= 0) {
+#ifdef _WIN32
+            _close(fd);
+#else
+            close(fd);
+#endif
+            fd = -1;
+        }
+    }
+    bool IsOpen() {
+        return pStaging != NULL;
+    }
+    /**
+    *   @brief  Queues nSize bytes at pFrame for writing. fnRelease(pFrame) is called from the
+    *   writer thread once the frame isn't needed anymore; without it the frame must stay valid
+    *   until the writer is destroyed. Returns false if the writer isn't open; the frame is
+    *   released right away then.
+    */
+    bool Write(uint8_t *pFrame, int nSize, std::function<void(uint8_t *)> fnRelease = nullptr) {
+        FrameItem item = {pFrame, nSize, fnRelease};
+        if (!IsOpen() || !queue.Push(std::move(item))) {
+            if (fnRelease) {
+                fnRelease(pFrame);
+            }
+            return false;
+        }
+        nMaxQueueDepth = (std::max)(nMaxQueueDepth, queue.GetDepth());
+        return true;
+    }
+    /**
+    *   @brief  Queues a copy of nSize bytes at pData, for small items such as container headers.
+    */
+    bool WriteCopy(const void *pData, int nSize) {
+        uint8_t *pCopy = new uint8_t[nSize];
+        memcpy(pCopy, pData, nSize);
+        return Write(pCopy, nSize, [](uint8_t *p) { delete[] p; });
+    }
+    /**
+    *   @brief  Number of frames waiting to be written; its high-water mark tells whether the
+    *   output storage keeps up with the producer.
+    */
+    int GetQueueDepth() {
+        return queue.GetDepth();
+    }
+    int GetMaxQueueDepth() {
+        return nMaxQueueDepth;
+    }
+    /**
+    *   @brief  Returns false if any write has failed; frames are dropped after a failure.
+    */
+    bool IsGood() {
+        return !bError;
+    }
+
+private:
+    struct FrameItem {
+        uint8_t *pFrame;
+        int nSize;
+        std::function<void(uint8_t *)> fnRelease;
+    };
+
+    void WriteProc() {
+        FrameItem item;
+        while (queue.Pop(&item)) {
+            if (!bDirect && item.nSize >= (int)nStagingSize) {
+                // Large frames go out as they are, after whatever is staged before them
+                if (FlushStaging()) {
+                    WriteAll(item.pFrame, item.nSize);
+                }
+            } else {
+                for (int nCopied = 0; nCopied < item.nSize;) {
+                    int n = (std::min)(item.nSize - nCopied, (int)(nStagingSize - nStaged));
+                    memcpy(pStaging + nStaged, item.pFrame + nCopied, n);
+                    nStaged += n;
+                    nCopied += n;
+                    if (nStaged == nStagingSize) {
+                        FlushStaging();
+                    }
+                }
+            }
+            if (item.fnRelease) {
+                item.fnRelease(item.pFrame);
+            }
+            item.fnRelease = nullptr;
+        }
+        FlushStaging();
+    }
+
+    bool FlushStaging() {
+        if (!nStaged) {
+            return true;
+        }
+#if !defined(_WIN32) && defined(O_DIRECT)
+        if (bDirect && nStaged % nAlignment) {
+            // Only the tail of the file can be unaligned, and direct I/O can't write it
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+        }
+#endif
+        bool bOk = WriteAll(pStaging, nStaged);
+        nStaged = 0;
+        return bOk;
+    }
+
+    bool WriteAll(const uint8_t *pData, size_t nSize) {
+        while (nSize && !bError) {
+#ifdef _WIN32
+            int n = _write(fd, pData, (unsigned)(std::min)(nSize, (size_t)INT_MAX));
+#else
+            ssize_t n = write(fd, pData, nSize);
+#endif
+            if (n <= 0) {
+                LOG(ERROR) << "Failed to write output file";
+                bError = true;
+                break;
+            }
+            pData += n;
+            nSize -= n;
+        }
+        return !bError;
+    }
+
+    static const size_t nAlignment = 4096;
+    int fd = -1;
+    bool bDirect;
+    std::atomic<bool> bError{false};
+    uint8_t *pStaging = NULL;
+    size_t nStagingSize = 0, nStaged = 0;
+    BoundedQueue<FrameItem> queue;
+    int nMaxQueueDepth = 0;
+    NvThread writeThread;
+};